@@ -0,0 +1,290 @@
+#include "../src/engine.hpp"
+#include "../src/map.hpp"
+#include "../src/world.hpp"
+#include "../src/dialog.hpp"
+#include "../src/ui.hpp"
+#include "../src/fov.hpp"
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+const int BENCH_WARMUP_SAMPLES = 3;
+const int BENCH_SAMPLES = 101;
+
+const int BENCH_MAP_SIZE = 1024;
+const int BENCH_WALL_PERCENT = 25;
+const int BENCH_NPCS = 5000;
+// Populations the NPC update is timed at, each given some ticks to settle into patrolling before sampling
+const int BENCH_UPDATE_NPCS[2] = { 2000, 20000 };
+const int BENCH_UPDATE_SETTLE_TICKS = 60;
+const int BENCH_TILE_QUERIES = 100000;
+const int BENCH_FOV_ORIGINS = 1000;
+const int BENCH_SIGHT_QUERIES = 100000;
+const int BENCH_RENDER_FRAMES = 10;
+const int BENCH_TEXT_RUNS = 100;
+const int BENCH_DIALOG_REPEATS = 10000;
+
+const char* BENCH_CSV_PATH = "./bench_map.csv";
+const char* BENCH_BINARY_PATH = "./bench_map.bin";
+
+typedef struct BenchResult {
+    std::string name;
+    int operations;
+    double median_ms;
+    double p99_ms;
+    double min_ms;
+} BenchResult;
+
+static std::vector<BenchResult> results;
+
+static double counter_ms(Uint64 counter) {
+    return (double)counter * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+// Times body over a fixed number of samples after a few unrecorded warmup runs, recording the median and
+// 99th percentile sample. Each sample runs body once, and body performs operations operations.
+static void bench_run(const char* name, int operations, const std::function<void()>& body) {
+    for(int i = 0; i < BENCH_WARMUP_SAMPLES; i++) {
+        body();
+    }
+
+    std::vector<double> samples;
+    for(int i = 0; i < BENCH_SAMPLES; i++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        body();
+        samples.push_back(counter_ms(SDL_GetPerformanceCounter() - start));
+    }
+    std::sort(samples.begin(), samples.end());
+
+    int p99_rank = std::min((int)(0.99 * samples.size()), (int)samples.size() - 1);
+    results.push_back((BenchResult) {
+        .name = name,
+        .operations = operations,
+        .median_ms = samples[samples.size() / 2],
+        .p99_ms = samples[p99_rank],
+        .min_ms = samples[0]
+    });
+    fprintf(stderr, "%-28s median %10.3f ms  p99 %10.3f ms\n", name, results.back().median_ms, results.back().p99_ms);
+}
+
+static void fill_map(Map& map, int size, unsigned int seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> percent_distribution(0, 99);
+    std::uniform_int_distribution<int> tile_distribution(0, 1);
+
+    map.resize(size, size);
+    for(int y = 0; y < size; y++) {
+        for(int x = 0; x < size; x++) {
+            map.set_tile(MAP_LAYER_GROUND, vec2(x, y), tile_distribution(rng));
+            map.set_wall(vec2(x, y), percent_distribution(rng) < BENCH_WALL_PERCENT);
+        }
+    }
+}
+
+static void bench_map_files() {
+    Map map;
+    fill_map(map, BENCH_MAP_SIZE, 1);
+
+    Map loaded;
+    bench_run("map_save_csv", 1, [&map] {
+        map.save_to_file(BENCH_CSV_PATH);
+    });
+    bench_run("map_load_csv", 1, [&loaded] {
+        loaded.load_from_file(BENCH_CSV_PATH);
+    });
+    bench_run("map_save_binary", 1, [&map] {
+        map.save_to_binary_file(BENCH_BINARY_PATH);
+    });
+    bench_run("map_load_binary", 1, [&loaded] {
+        loaded.load_from_file(BENCH_BINARY_PATH);
+    });
+
+    remove(BENCH_CSV_PATH);
+    remove(BENCH_BINARY_PATH);
+}
+
+static void bench_world_queries() {
+    World* world = new World();
+    world->populate(BENCH_NPCS, 1);
+
+    // Query the area populate grows the map to, so that most queries land on real tiles
+    int side = (int)ceil(sqrt((double)BENCH_NPCS * 8.0));
+    std::mt19937 rng(2);
+    std::uniform_int_distribution<int> coordinate_distribution(0, side - 1);
+    std::vector<vec2> tiles;
+    for(int i = 0; i < BENCH_TILE_QUERIES; i++) {
+        tiles.push_back(vec2(coordinate_distribution(rng), coordinate_distribution(rng)));
+    }
+
+    int free_tiles = 0;
+    bench_run("world_is_tile_free", BENCH_TILE_QUERIES, [world, &tiles, &free_tiles] {
+        for(const vec2& tile : tiles) {
+            free_tiles += world->is_tile_free(tile);
+        }
+    });
+
+    delete world;
+}
+
+// One sample is one world tick, which has to fit in the 16.7 ms a frame has at 60 Hz
+static void bench_world_update() {
+    for(int npc_count : BENCH_UPDATE_NPCS) {
+        World* world = new World();
+        world->set_worker_count(1);
+        world->populate(npc_count, 1);
+        for(int tick = 0; tick < BENCH_UPDATE_SETTLE_TICKS; tick++) {
+            world->update();
+        }
+
+        std::string name = "world_update_" + std::to_string(npc_count) + "_npcs";
+        bench_run(name.c_str(), npc_count, [world] {
+            world->update();
+        });
+
+        delete world;
+    }
+}
+
+static void bench_field_of_view() {
+    Map map;
+    fill_map(map, BENCH_MAP_SIZE, 4);
+
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> coordinate_distribution(0, BENCH_MAP_SIZE - 1);
+    std::uniform_int_distribution<int> offset_distribution(-FieldOfView::RADIUS, FieldOfView::RADIUS);
+    std::vector<vec2> origins;
+    std::vector<vec2> targets;
+    for(int i = 0; i < BENCH_SIGHT_QUERIES; i++) {
+        origins.push_back(vec2(coordinate_distribution(rng), coordinate_distribution(rng)));
+        targets.push_back(origins.back() + vec2(offset_distribution(rng), offset_distribution(rng)));
+    }
+
+    // Every origin is a new tile, so every update recomputes the field
+    FieldOfView fov;
+    bench_run("fov_compute", BENCH_FOV_ORIGINS, [&fov, &map, &origins] {
+        for(int i = 0; i < BENCH_FOV_ORIGINS; i++) {
+            fov.update(map, origins[i]);
+        }
+    });
+
+    int seen = 0;
+    bench_run("fov_line_of_sight", BENCH_SIGHT_QUERIES, [&map, &origins, &targets, &seen] {
+        for(int i = 0; i < BENCH_SIGHT_QUERIES; i++) {
+            seen += FieldOfView::line_of_sight(map, origins[i], targets[i]);
+        }
+    });
+}
+
+static void bench_rendering(Engine& engine) {
+    Map map;
+    fill_map(map, BENCH_MAP_SIZE, 3);
+
+    // A still camera draws from cached chunks, a moving one keeps rendering chunks as they come into view
+    map.camera_position = vec2(0, 0);
+    bench_run("map_render_walls_still", BENCH_RENDER_FRAMES, [&engine, &map] {
+        for(int frame = 0; frame < BENCH_RENDER_FRAMES; frame++) {
+            engine.render_clear();
+            map.render_with_walls(&engine, true);
+            engine.render_flush();
+            engine.render_present();
+        }
+    });
+
+    int scroll = 0;
+    bench_run("map_render_walls_scrolling", BENCH_RENDER_FRAMES, [&engine, &map, &scroll] {
+        for(int frame = 0; frame < BENCH_RENDER_FRAMES; frame++) {
+            scroll = (scroll + Engine::TILE_SIZE) % ((BENCH_MAP_SIZE * Engine::TILE_SIZE) - Engine::SCREEN_WIDTH);
+            map.camera_position = vec2(scroll, scroll / 2);
+            engine.render_clear();
+            map.render_with_walls(&engine, true);
+            engine.render_flush();
+            engine.render_present();
+        }
+    });
+
+    // The same text every time is served from the run cache, text that keeps changing rebuilds runs
+    bench_run("render_text_cached", BENCH_TEXT_RUNS, [&engine] {
+        for(int i = 0; i < BENCH_TEXT_RUNS; i++) {
+            engine.render_text("FPS 60 UPS 60", 0, 0);
+        }
+        engine.render_flush();
+    });
+
+    int counter = 0;
+    bench_run("render_text_changing", BENCH_TEXT_RUNS, [&engine, &counter] {
+        TextBuffer text;
+        for(int i = 0; i < BENCH_TEXT_RUNS; i++) {
+            text.clear();
+            text.append("DC ");
+            text.append_int(counter++);
+            engine.render_text(text.text, 0, 8);
+        }
+        engine.render_flush();
+    });
+}
+
+static void bench_dialog() {
+    std::string message;
+    for(int i = 0; i < BENCH_DIALOG_REPEATS; i++) {
+        message += "I'm looking for wild mushrooms! ";
+    }
+
+    bench_run("dialog_paginate", 1, [&message] {
+        DialogTable table;
+        table.add("bench", message.c_str(), message.length());
+    });
+
+    DialogTable table;
+    int dialog = table.add("bench", message.c_str(), message.length());
+    int pages = table.entry(dialog).page_count;
+    bench_run("dialog_page_through", pages, [&table, dialog] {
+        UI ui;
+        ui.set_dialog_table(&table);
+        ui.dialog_open(dialog);
+        while(ui.dialog_is_open) {
+            ui.dialog_progress();
+            ui.dialog_progress();
+        }
+    });
+}
+
+// Runs every benchmark and prints the results to stdout as JSON, with progress on stderr.
+// Run from the repository root so the sprite sheets and asset pack resolve.
+int main() {
+    // The engine reports problems on std::cout, which would end up in the JSON
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+    Engine engine;
+    if(!engine.init_offscreen()) {
+        return 1;
+    }
+
+    bench_map_files();
+    bench_world_queries();
+    bench_world_update();
+    bench_field_of_view();
+    bench_rendering(engine);
+    bench_dialog();
+
+    engine.quit();
+
+    printf("{\n");
+    printf("  \"samples\": %d,\n", BENCH_SAMPLES);
+    printf("  \"benchmarks\": [\n");
+    for(size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        printf("    { \"name\": \"%s\", \"operations\": %d, \"median_ms\": %.4f, \"p99_ms\": %.4f, \"min_ms\": %.4f }%s\n",
+               result.name.c_str(), result.operations, result.median_ms, result.p99_ms, result.min_ms, i + 1 == results.size() ? "" : ",");
+    }
+    printf("  ]\n");
+    printf("}\n");
+
+    return 0;
+}
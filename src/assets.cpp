@@ -0,0 +1,208 @@
+#include "assets.hpp"
+
+#include <SDL2/SDL_image.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char ASSET_PACK_MAGIC[4] = { 'F', 'F', 'A', 'P' };
+const char* ASSET_PACK_PATH = "./res/assets.pack";
+
+// Sprite data
+const SpriteData sprite_data[SPRITE_COUNT] = {
+    (SpriteData) {
+        .path = "./res/gfx/font.png",
+        .frame_size = { 8, 8 },
+    },
+    (SpriteData) {
+        .path = "./res/gfx/frame.png",
+        .frame_size = { 8, 8 },
+    },
+    (SpriteData) {
+        .path = "./res/gfx/tiles.png",
+        .frame_size = { Engine::TILE_SIZE, Engine::TILE_SIZE },
+    },
+    (SpriteData) {
+        .path = "./res/gfx/witch.png",
+        .frame_size = { Engine::TILE_SIZE, Engine::TILE_SIZE },
+    }
+};
+
+static bool asset_source_stat(const char* path, int64_t& size, int64_t& mtime) {
+    struct stat file_stat;
+    if(stat(path, &file_stat) == -1) {
+        return false;
+    }
+
+    size = file_stat.st_size;
+    mtime = file_stat.st_mtime;
+    return true;
+}
+
+// Decodes every sprite sheet and packs them into a single RGBA32 atlas. Sheets are placed tallest first in rows
+// of up to ATLAS_WIDTH pixels, with ATLAS_PADDING transparent pixels between them. SDL_image must be initialized.
+SDL_Surface* assets_build_atlas(AssetPackSprite sprites[SPRITE_COUNT]) {
+    SDL_Surface* loaded_surfaces[SPRITE_COUNT];
+    int packing_order[SPRITE_COUNT];
+    for(int i = 0; i < SPRITE_COUNT; i++) {
+        loaded_surfaces[i] = IMG_Load(sprite_data[i].path);
+        if(loaded_surfaces[i] == NULL) {
+            std::cout << "Unable to load texture image! SDL Error: " << IMG_GetError() << std::endl;
+            for(int j = 0; j < i; j++) {
+                SDL_FreeSurface(loaded_surfaces[j]);
+            }
+            return NULL;
+        }
+
+        sprites[i] = (AssetPackSprite) {
+            .width = loaded_surfaces[i]->w,
+            .height = loaded_surfaces[i]->h,
+            .frame_width = sprite_data[i].frame_size[0],
+            .frame_height = sprite_data[i].frame_size[1],
+            .frame_count = loaded_surfaces[i]->w / sprite_data[i].frame_size[0],
+            .atlas_x = 0,
+            .atlas_y = 0,
+            .padding = 0,
+            .source_size = 0,
+            .source_mtime = 0
+        };
+        asset_source_stat(sprite_data[i].path, sprites[i].source_size, sprites[i].source_mtime);
+        packing_order[i] = i;
+    }
+
+    std::sort(packing_order, packing_order + SPRITE_COUNT, [sprites](int a, int b) {
+        return sprites[a].height > sprites[b].height;
+    });
+
+    int atlas_width = Engine::ATLAS_WIDTH;
+    int atlas_height = 0;
+    int row_x = 0;
+    int row_height = 0;
+    for(int i = 0; i < SPRITE_COUNT; i++) {
+        AssetPackSprite& sprite = sprites[packing_order[i]];
+        atlas_width = std::max(atlas_width, (int)sprite.width);
+        if(row_x != 0 && row_x + sprite.width > atlas_width) {
+            atlas_height += row_height + Engine::ATLAS_PADDING;
+            row_x = 0;
+            row_height = 0;
+        }
+
+        sprite.atlas_x = row_x;
+        sprite.atlas_y = atlas_height;
+        row_x += sprite.width + Engine::ATLAS_PADDING;
+        row_height = std::max(row_height, (int)sprite.height);
+    }
+    atlas_height += row_height;
+
+    SDL_Surface* atlas = SDL_CreateRGBSurfaceWithFormat(0, atlas_width, atlas_height, 32, SDL_PIXELFORMAT_RGBA32);
+    if(atlas == NULL) {
+        std::cout << "Unable to create sprite atlas! SDL Error: " << SDL_GetError() << std::endl;
+    } else {
+        for(int i = 0; i < SPRITE_COUNT; i++) {
+            // Copy the sheets' alpha as is rather than blending them onto the empty atlas
+            SDL_SetSurfaceBlendMode(loaded_surfaces[i], SDL_BLENDMODE_NONE);
+            SDL_Rect dest_rect = (SDL_Rect) {
+                .x = sprites[i].atlas_x,
+                .y = sprites[i].atlas_y,
+                .w = sprites[i].width,
+                .h = sprites[i].height
+            };
+            SDL_BlitSurface(loaded_surfaces[i], NULL, atlas, &dest_rect);
+        }
+    }
+
+    for(int i = 0; i < SPRITE_COUNT; i++) {
+        SDL_FreeSurface(loaded_surfaces[i]);
+    }
+
+    return atlas;
+}
+
+bool assets_write_pack(const char* path, const AssetPackSprite sprites[SPRITE_COUNT], SDL_Surface* atlas) {
+    std::ofstream pack_file(path, std::ios::binary);
+    if(!pack_file.is_open()) {
+        std::cout << "Unable to open file!" << std::endl;
+        return false;
+    }
+
+    AssetPackHeader header;
+    memcpy(header.magic, ASSET_PACK_MAGIC, 4);
+    header.version = ASSET_PACK_VERSION;
+    header.sprite_count = SPRITE_COUNT;
+    header.atlas_width = atlas->w;
+    header.atlas_height = atlas->h;
+
+    pack_file.write((const char*)&header, sizeof(header));
+    pack_file.write((const char*)sprites, sizeof(AssetPackSprite) * SPRITE_COUNT);
+    for(int y = 0; y < atlas->h; y++) {
+        pack_file.write((const char*)atlas->pixels + (y * atlas->pitch), atlas->w * 4);
+    }
+
+    if(!pack_file.good()) {
+        std::cout << "Unable to write asset pack!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Maps a pack into memory and checks it matches this build's sprites and the sheets on disk. Returns false
+// without a message if there is no pack, since the sprite sheets are then loaded directly. Sheets that are
+// missing don't make the pack stale, since it is then the only copy of them.
+bool asset_pack_open(const char* path, AssetPack& pack) {
+    int fd = open(path, O_RDONLY);
+    if(fd == -1) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) == -1 || (size_t)file_stat.st_size < sizeof(AssetPackHeader)) {
+        std::cout << "Invalid asset pack!" << std::endl;
+        close(fd);
+        return false;
+    }
+
+    pack.size = file_stat.st_size;
+    pack.data = mmap(NULL, pack.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(pack.data == MAP_FAILED) {
+        std::cout << "Unable to map file!" << std::endl;
+        return false;
+    }
+
+    pack.header = (const AssetPackHeader*)pack.data;
+    pack.sprites = (const AssetPackSprite*)((const char*)pack.data + sizeof(AssetPackHeader));
+    pack.pixels = (const uint8_t*)(pack.sprites + SPRITE_COUNT);
+
+    bool valid = memcmp(pack.header->magic, ASSET_PACK_MAGIC, 4) == 0 &&
+                 pack.header->version == ASSET_PACK_VERSION &&
+                 pack.header->sprite_count == SPRITE_COUNT &&
+                 pack.header->atlas_width > 0 && pack.header->atlas_height > 0 &&
+                 pack.size >= sizeof(AssetPackHeader) + (sizeof(AssetPackSprite) * SPRITE_COUNT) + ((size_t)pack.header->atlas_width * pack.header->atlas_height * 4);
+    for(int i = 0; valid && i < SPRITE_COUNT; i++) {
+        valid = pack.sprites[i].frame_width == sprite_data[i].frame_size[0] && pack.sprites[i].frame_height == sprite_data[i].frame_size[1];
+
+        int64_t source_size = 0;
+        int64_t source_mtime = 0;
+        if(valid && asset_source_stat(sprite_data[i].path, source_size, source_mtime)) {
+            valid = pack.sprites[i].source_size == source_size && pack.sprites[i].source_mtime == source_mtime;
+        }
+    }
+    if(!valid) {
+        std::cout << "Asset pack is invalid or out of date, loading sprite sheets instead!" << std::endl;
+        asset_pack_close(pack);
+        return false;
+    }
+
+    return true;
+}
+
+void asset_pack_close(AssetPack& pack) {
+    munmap(pack.data, pack.size);
+    pack.data = NULL;
+}
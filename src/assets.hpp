@@ -0,0 +1,57 @@
+#pragma once
+
+#include "engine.hpp"
+#include <SDL2/SDL.h>
+#include <cstddef>
+#include <cstdint>
+
+typedef struct SpriteData {
+    const char* path;
+    const int frame_size[2];
+} SpriteData;
+
+extern const SpriteData sprite_data[SPRITE_COUNT];
+
+// Asset packs hold the sprite atlas already decoded and packed, so the game can start without SDL_image.
+// The file is a header, then one AssetPackSprite per sprite, then the atlas as RGBA32 rows. Each sprite
+// records the size and modification time its sheet had when baked, and a pack whose sheets have changed
+// since is ignored.
+extern const char ASSET_PACK_MAGIC[4];
+extern const char* ASSET_PACK_PATH;
+static const uint32_t ASSET_PACK_VERSION = 2;
+
+typedef struct AssetPackHeader {
+    char magic[4];
+    uint32_t version;
+    int32_t sprite_count;
+    int32_t atlas_width;
+    int32_t atlas_height;
+} AssetPackHeader;
+
+typedef struct AssetPackSprite {
+    int32_t width;
+    int32_t height;
+    int32_t frame_width;
+    int32_t frame_height;
+    int32_t frame_count;
+    int32_t atlas_x;
+    int32_t atlas_y;
+    int32_t padding;
+    int64_t source_size;
+    int64_t source_mtime;
+} AssetPackSprite;
+
+// A pack file mapped into memory, valid until closed
+typedef struct AssetPack {
+    void* data;
+    size_t size;
+    const AssetPackHeader* header;
+    const AssetPackSprite* sprites;
+    const uint8_t* pixels;
+} AssetPack;
+
+SDL_Surface* assets_build_atlas(AssetPackSprite sprites[SPRITE_COUNT]);
+bool assets_write_pack(const char* path, const AssetPackSprite sprites[SPRITE_COUNT], SDL_Surface* atlas);
+
+bool asset_pack_open(const char* path, AssetPack& pack);
+void asset_pack_close(AssetPack& pack);
@@ -0,0 +1,118 @@
+#include "dialog.hpp"
+
+#include <fstream>
+#include <iostream>
+
+const char* DIALOG_TABLE_PATH = "./res/dialog.txt";
+
+bool DialogTable::load(const char* path) {
+    std::ifstream infile(path, std::ios::in | std::ios::binary);
+    if(!infile.is_open()) {
+        std::cout << "Unable to open file!" << std::endl;
+        return false;
+    }
+
+    infile.seekg(0, std::ios::end);
+    std::string contents((size_t)infile.tellg(), '\0');
+    infile.seekg(0, std::ios::beg);
+    infile.read(&contents[0], contents.length());
+    infile.close();
+
+    size_t line_start = 0;
+    while(line_start < contents.length()) {
+        size_t line_end = contents.find('\n', line_start);
+        if(line_end == std::string::npos) {
+            line_end = contents.length();
+        }
+        size_t next_line = line_end + 1;
+        if(line_end > line_start && contents[line_end - 1] == '\r') {
+            line_end--;
+        }
+
+        if(line_end > line_start && contents[line_start] != '#') {
+            size_t separator = contents.find('=', line_start);
+            if(separator == std::string::npos || separator >= line_end) {
+                std::cout << "Invalid dialog line: " << contents.substr(line_start, line_end - line_start) << "!" << std::endl;
+            } else {
+                add(contents.substr(line_start, separator - line_start), contents.c_str() + separator + 1, line_end - separator - 1);
+            }
+        }
+        line_start = next_line;
+    }
+
+    return true;
+}
+
+// Adds a message under a name, replacing whatever the name referred to before. Returns the message's id.
+int DialogTable::add(const std::string& name, const char* message, size_t length) {
+    size_t start = text.length();
+    text.append(message, length);
+
+    int dialog = (int)entries.size();
+    entries.push_back((DialogEntry) {
+        .first_page = (int)pages.size(),
+        .page_count = 0
+    });
+    paginate(start, text.length());
+    entries.back().page_count = (int)pages.size() - entries.back().first_page;
+    ids[name] = dialog;
+
+    return dialog;
+}
+
+int DialogTable::find(const char* name) const {
+    auto dialog = ids.find(name);
+    if(dialog == ids.end()) {
+        return DIALOG_NONE;
+    }
+    return dialog->second;
+}
+
+// Word wraps the text between start and end into pages. Words wrap onto the next row when they don't fit,
+// a space after a word is kept if the row has room for it, and words longer than a row are split.
+void DialogTable::paginate(size_t start, size_t end) {
+    size_t cursor = start;
+    while(cursor < end) {
+        DialogPage page = {};
+        page.rows[0].offset = cursor;
+        page.rows[1].offset = cursor;
+
+        int row = 0;
+        size_t col = 0;
+        while(cursor < end) {
+            // Find the next word's size
+            size_t word_end = text.find(' ', cursor);
+            bool followed_by_space = word_end < end;
+            if(!followed_by_space) {
+                word_end = end;
+            }
+            size_t word_size = word_end - cursor;
+            if(word_size > DIALOG_ROW_LENGTH) {
+                word_size = DIALOG_ROW_LENGTH;
+                followed_by_space = false;
+            }
+
+            // Check if we have space on this row for that word
+            if(col + word_size > DIALOG_ROW_LENGTH) {
+                row++;
+                col = 0;
+                if(row == 2) {
+                    break;
+                }
+                page.rows[row].offset = cursor;
+            }
+
+            cursor += word_size;
+            col += word_size;
+            if(followed_by_space) {
+                cursor++;
+                if(col < DIALOG_ROW_LENGTH) {
+                    col++;
+                }
+            }
+            page.rows[row].length = col;
+        }
+
+        pages.push_back(page);
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+const size_t DIALOG_ROW_LENGTH = 18;
+const int DIALOG_NONE = -1;
+
+extern const char* DIALOG_TABLE_PATH;
+
+// Where one row of a dialog page sits in the table's text. Rows are never longer than DIALOG_ROW_LENGTH.
+typedef struct DialogRow {
+    uint32_t offset;
+    uint32_t length;
+} DialogRow;
+
+typedef struct DialogPage {
+    DialogRow rows[2];
+} DialogPage;
+
+typedef struct DialogEntry {
+    int first_page;
+    int page_count;
+} DialogEntry;
+
+// Every message the game can show, interned back to back in one string and word wrapped into pages of
+// two rows as it is added, so showing dialog only ever copies rows out of the table.
+// Dialog files hold one message per line as name=message, and lines starting with # are ignored.
+class DialogTable {
+    public:
+        bool load(const char* path);
+        int add(const std::string& name, const char* message, size_t length);
+        int find(const char* name) const;
+
+        int count() const {
+            return (int)entries.size();
+        }
+        int page_count() const {
+            return (int)pages.size();
+        }
+        const DialogEntry& entry(int dialog) const {
+            return entries[dialog];
+        }
+        const DialogPage& page(int page) const {
+            return pages[page];
+        }
+        const char* row_text(const DialogRow& row) const {
+            return text.data() + row.offset;
+        }
+    private:
+        std::string text;
+        std::vector<DialogEntry> entries;
+        std::vector<DialogPage> pages;
+        std::unordered_map<std::string, int> ids;
+
+        void paginate(size_t start, size_t end);
+};
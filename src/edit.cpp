@@ -1,10 +1,14 @@
 #include "edit.hpp"
 
 #include <vector>
+#include <algorithm>
 #include <iostream>
 
+static const char* layer_names[MAP_LAYER_COUNT] = { "GROUND", "DETAIL", "OVERLAY" };
+
 Edit::Edit() {
     tool = TOOL_DRAW;
+    layer = MAP_LAYER_GROUND;
     mouse_pos = vec2(0, 0);
     panning = false;
     drawing = false;
@@ -14,6 +18,11 @@ Edit::Edit() {
 
     command = "";
     typing = false;
+
+    visible_changed = true;
+    rendered_animation_steps = 0;
+
+    map.load_tile_animations(TILE_ANIMATIONS_PATH);
 }
 
 Edit::~Edit() {
@@ -21,6 +30,8 @@ Edit::~Edit() {
 }
 
 void Edit::handle_input(SDL_Event e) {
+    visible_changed = true;
+
     if(e.type == SDL_MOUSEMOTION) {
         mouse_pos = vec2(e.motion.x, e.motion.y);
 
@@ -39,9 +50,12 @@ void Edit::handle_input(SDL_Event e) {
             if(tool == TOOL_SELECT_TILE) {
                 handle_select_tile();
             } else if(tool == TOOL_DRAW) {
+                journal.stroke_begin();
                 drawing = true;
             } else if(tool == TOOL_WALL) {
                 handle_toggle_wall();
+            } else if(tool == TOOL_FILL) {
+                handle_fill((SDL_GetModState() & KMOD_SHIFT) != 0);
             }
         }
     } else if(e.type == SDL_MOUSEBUTTONUP) {
@@ -49,6 +63,7 @@ void Edit::handle_input(SDL_Event e) {
             panning = false;
         } else if(e.button.button == SDL_BUTTON_LEFT) {
             drawing = false;
+            journal.stroke_end();
         }
     } else if(e.type == SDL_KEYDOWN) {
         int key = e.key.keysym.sym;
@@ -69,16 +84,40 @@ void Edit::handle_input(SDL_Event e) {
         }
 
         drawing = false;
+        journal.stroke_end();
+
+        // Ctrl+Z undoes, Ctrl+Y or Ctrl+Shift+Z redoes
+        if(!typing && (e.key.keysym.mod & KMOD_CTRL) != 0 && (key == SDLK_z || key == SDLK_y)) {
+            if(key == SDLK_z && (e.key.keysym.mod & KMOD_SHIFT) == 0) {
+                journal.undo(map);
+            } else {
+                journal.redo(map);
+            }
+            return;
+        }
+
         switch(key) {
             case SDLK_b:
                 tool = TOOL_DRAW;
                 break;
+            case SDLK_f:
+                tool = TOOL_FILL;
+                break;
             case SDLK_t:
                 tool = TOOL_SELECT_TILE;
                 break;
             case SDLK_w:
                 tool = TOOL_WALL;
                 break;
+            // 1 to 3 pick the layer to edit, V shows or hides it
+            case SDLK_1:
+            case SDLK_2:
+            case SDLK_3:
+                layer = (MapLayer)(MAP_LAYER_GROUND + (key - SDLK_1));
+                break;
+            case SDLK_v:
+                map.layer_visible[layer] = !map.layer_visible[layer];
+                break;
             case SDLK_BACKQUOTE:
                 typing = !typing;
                 command = "";
@@ -104,11 +143,39 @@ void Edit::handle_command() {
         int new_width = atoi(command_parts.at(1).c_str());
         int new_height = atoi(command_parts.at(2).c_str());
         map.resize(new_width, new_height);
+        journal.clear();
 
     } else if(command_parts.at(0) == "save" && command_parts.size() == 2) {
-        map.save_to_file(command_parts.at(1).c_str());
+        // Maps saved with a .bin extension use the binary format, anything else is saved as CSV
+        const std::string& path = command_parts.at(1);
+        if(path.length() > 4 && path.compare(path.length() - 4, 4, ".bin") == 0) {
+            map.save_to_binary_file(path.c_str());
+        } else {
+            map.save_to_file(path.c_str());
+        }
     } else if(command_parts.at(0) == "load" && command_parts.size() == 2) {
         map.load_from_file(command_parts.at(1).c_str());
+        journal.clear();
+    } else if(command_parts.at(0) == "stream" && command_parts.size() == 3) {
+        size_t memory_budget_kb = (size_t)atoi(command_parts.at(2).c_str());
+        map.open_paged(command_parts.at(1).c_str(), memory_budget_kb * 1024);
+        journal.clear();
+    } else if(command_parts.at(0) == "clear" && command_parts.size() == 5) {
+        // Clamp the rectangle to the map, then journal every cell it changes before clearing it in one go
+        vec2 from = vec2(std::max(atoi(command_parts.at(1).c_str()), 0), std::max(atoi(command_parts.at(2).c_str()), 0));
+        vec2 to = vec2(std::min(from.x + atoi(command_parts.at(3).c_str()), map.width), std::min(from.y + atoi(command_parts.at(4).c_str()), map.height));
+        journal.stroke_begin();
+        for(int y = from.y; y < to.y; y++) {
+            for(int x = from.x; x < to.x; x++) {
+                for(int cleared_layer = 0; cleared_layer < MAP_LAYER_COUNT; cleared_layer++) {
+                    int cleared_tile = cleared_layer == MAP_LAYER_GROUND ? 0 : MAP_TILE_EMPTY;
+                    journal.record((JournalLayer)cleared_layer, (y * map.width) + x, map.get_tile((MapLayer)cleared_layer, vec2(x, y)), cleared_tile);
+                }
+                journal.record(JOURNAL_WALLS, (y * map.width) + x, (int)map.get_wall(vec2(x, y)), 0);
+            }
+        }
+        journal.stroke_end();
+        map.clear_region(from, to - from);
     }
 
     command = "";
@@ -116,11 +183,17 @@ void Edit::handle_command() {
 }
 
 void Edit::update() {
+    map.update();
     if(!panning && drawing) {
         handle_draw_tile();
+        visible_changed = true;
     }
 }
 
+bool Edit::has_visible_changes(Engine* engine) {
+    return visible_changed || map.visible_animation_steps() != rendered_animation_steps;
+}
+
 void Edit::render(Engine* engine) {
     if(tool == TOOL_SELECT_TILE) {
         engine->render_sprite(SPRITE_TILES, -tileset_camera_pos.x, -tileset_camera_pos.y);
@@ -134,28 +207,38 @@ void Edit::render(Engine* engine) {
             .w = Engine::TILE_SIZE,
             .h = Engine::TILE_SIZE
         };
+        engine->render_flush();
         SDL_SetRenderDrawColor(engine->renderer, 255, 255, 0, 255);
         SDL_RenderDrawRect(engine->renderer, &tile_rect);
     } else {
         map.render_with_walls(engine, tool == TOOL_WALL);
 
-        if(tool == TOOL_DRAW || tool == TOOL_WALL) {
+        if(tool == TOOL_DRAW || tool == TOOL_WALL || tool == TOOL_FILL) {
             vec2 mouse_tile = tile_at(mouse_pos + map.camera_position);
             if(map.in_bounds(mouse_tile)) {
                 vec2 preview_pos = position_of(mouse_tile) - map.camera_position;
-                if(tool == TOOL_DRAW) {
+                if(tool == TOOL_DRAW || tool == TOOL_FILL) {
                     engine->render_sprite_frame(SPRITE_TILES, selected_tile, preview_pos.x, preview_pos.y, false);
                 } else {
+                    engine->render_flush();
                     SDL_RenderDrawLine(engine->renderer, preview_pos.x, preview_pos.y, preview_pos.x + Engine::TILE_SIZE, preview_pos.y + Engine::TILE_SIZE);
                     SDL_RenderDrawLine(engine->renderer, preview_pos.x, preview_pos.y + Engine::TILE_SIZE, preview_pos.x + Engine::TILE_SIZE, preview_pos.y);
                 }
             }
         }
+
+        engine->render_text(layer_names[layer], 0, 0);
+        if(!map.layer_visible[layer]) {
+            engine->render_text("HIDDEN", 0, 8);
+        }
     }
 
     if(typing) {
         engine->render_text(command.c_str(), 0, Engine::SCREEN_HEIGHT - 8);
     }
+
+    visible_changed = false;
+    rendered_animation_steps = map.visible_animation_steps();
 }
 
 void Edit::handle_select_tile() {
@@ -170,16 +253,99 @@ void Edit::handle_select_tile() {
     selected_tile = attempt_long_x;
 }
 
+// Holding shift erases from the layers above the ground instead
 void Edit::handle_draw_tile() {
     vec2 attempt_draw_tile = tile_at(mouse_pos + map.camera_position);
     if(map.in_bounds(attempt_draw_tile)) {
-        map.set_tile(attempt_draw_tile, selected_tile);
+        int tile = selected_tile;
+        if(layer != MAP_LAYER_GROUND && (SDL_GetModState() & KMOD_SHIFT) != 0) {
+            tile = MAP_TILE_EMPTY;
+        }
+        journal.record((JournalLayer)layer, (attempt_draw_tile.y * map.width) + attempt_draw_tile.x, map.get_tile(layer, attempt_draw_tile), tile);
+        map.set_tile(layer, attempt_draw_tile, tile);
     }
 }
 
 void Edit::handle_toggle_wall() {
     vec2 attempt_wall_tile = tile_at(mouse_pos + map.camera_position);
     if(map.in_bounds(attempt_wall_tile)) {
-        map.set_wall(attempt_wall_tile, !map.get_wall(attempt_wall_tile));
+        bool wall = map.get_wall(attempt_wall_tile);
+        journal.stroke_begin();
+        journal.record(JOURNAL_WALLS, (attempt_wall_tile.y * map.width) + attempt_wall_tile.x, wall, !wall);
+        journal.stroke_end();
+        map.set_wall(attempt_wall_tile, !wall);
+    }
+}
+
+// Fills the area of the edited layer connected to the clicked tile with the selected tile, or when filling walls,
+// toggles the walls of the area connected to it that share its wall state
+void Edit::handle_fill(bool walls) {
+    vec2 fill_tile = tile_at(mouse_pos + map.camera_position);
+    if(fill_tile.x < 0 || fill_tile.x >= map.width || fill_tile.y < 0 || fill_tile.y >= map.height) {
+        return;
+    }
+
+    journal.stroke_begin();
+    if(walls) {
+        flood_fill(fill_tile, JOURNAL_WALLS, !map.get_wall(fill_tile));
+    } else {
+        flood_fill(fill_tile, (JournalLayer)layer, selected_tile);
+    }
+    journal.stroke_end();
+}
+
+int Edit::cell_value(vec2 pos, JournalLayer layer) const {
+    return layer == JOURNAL_WALLS ? (int)map.get_wall(pos) : map.get_tile((MapLayer)layer, pos);
+}
+
+// Scanline flood fill. Each seed is grown into the widest span of matching cells on its row, the span is set in one
+// run, and the start of every matching span directly above and below it becomes a new seed.
+void Edit::flood_fill(vec2 start, JournalLayer layer, int value) {
+    int target = cell_value(start, layer);
+    if(target == value) {
+        return;
+    }
+
+    fill_seeds.clear();
+    fill_seeds.push_back(start);
+    while(!fill_seeds.empty()) {
+        vec2 seed = fill_seeds.back();
+        fill_seeds.pop_back();
+        if(cell_value(seed, layer) != target) {
+            continue;
+        }
+
+        int first_x = seed.x;
+        int last_x = seed.x;
+        while(first_x > 0 && cell_value(vec2(first_x - 1, seed.y), layer) == target) {
+            first_x--;
+        }
+        while(last_x < map.width - 1 && cell_value(vec2(last_x + 1, seed.y), layer) == target) {
+            last_x++;
+        }
+
+        int index = (seed.y * map.width) + first_x;
+        int length = (last_x - first_x) + 1;
+        journal.record_run(layer, index, length, target, value);
+        if(layer == JOURNAL_WALLS) {
+            map.set_wall_run(index, length, value != 0);
+        } else {
+            map.set_tile_run((MapLayer)layer, index, length, value);
+        }
+
+        for(int neighbour_y = seed.y - 1; neighbour_y <= seed.y + 1; neighbour_y += 2) {
+            if(neighbour_y < 0 || neighbour_y >= map.height) {
+                continue;
+            }
+
+            bool in_span = false;
+            for(int x = first_x; x <= last_x; x++) {
+                bool matches = cell_value(vec2(x, neighbour_y), layer) == target;
+                if(matches && !in_span) {
+                    fill_seeds.push_back(vec2(x, neighbour_y));
+                }
+                in_span = matches;
+            }
+        }
     }
 }
@@ -3,13 +3,16 @@
 #include "state.hpp"
 #include "engine.hpp"
 #include "map.hpp"
+#include "journal.hpp"
 #include <SDL2/SDL.h>
 #include <string>
+#include <vector>
 
 typedef enum EditTool {
     TOOL_DRAW,
     TOOL_SELECT_TILE,
-    TOOL_WALL
+    TOOL_WALL,
+    TOOL_FILL
 } EditTool;
 
 class Edit : public State {
@@ -20,14 +23,20 @@ class Edit : public State {
         void handle_input(SDL_Event e) override;
         void update() override;
         void render(Engine* engine) override;
+        bool has_visible_changes(Engine* engine) override;
 
         void handle_select_tile();
         void handle_draw_tile();
         void handle_toggle_wall();
+        void handle_fill(bool walls);
     private:
         Map map;
+        Journal journal;
+        std::vector<vec2> fill_seeds;
 
         EditTool tool;
+        // The tile layer drawn and filled on
+        MapLayer layer;
         vec2 mouse_pos;
         bool panning;
         bool drawing;
@@ -38,5 +47,11 @@ class Edit : public State {
         std::string command;
         bool typing;
 
+        // Set by anything that could change what's drawn, cleared by rendering
+        bool visible_changed;
+        uint32_t rendered_animation_steps;
+
         void handle_command();
+        int cell_value(vec2 pos, JournalLayer layer) const;
+        void flood_fill(vec2 start, JournalLayer layer, int value);
 };
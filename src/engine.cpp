@@ -1,40 +1,19 @@
 #include "engine.hpp"
+#include "assets.hpp"
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <string>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
-const float FRAME_DURATION = 1.0f / 60.0f;
-
 int sprite_frame_count[SPRITE_COUNT];
 int sprite_texture_width[SPRITE_COUNT];
 int sprite_texture_height[SPRITE_COUNT];
 
-// Sprite data
-typedef struct SpriteData {
-    const char* path;
-    const int frame_size[2];
-} SpriteData;
-
-const SpriteData sprite_data[SPRITE_COUNT] = {
-    (SpriteData) {
-        .path = "./res/gfx/font.png",
-        .frame_size = { 8, 8 },
-    },
-    (SpriteData) {
-        .path = "./res/gfx/frame.png",
-        .frame_size = { 8, 8 },
-    },
-    (SpriteData) {
-        .path = "./res/gfx/tiles.png",
-        .frame_size = { Engine::TILE_SIZE, Engine::TILE_SIZE },
-    },
-    (SpriteData) {
-        .path = "./res/gfx/witch.png",
-        .frame_size = { Engine::TILE_SIZE, Engine::TILE_SIZE },
-    }
-};
+// Where each sprite sheet's top left corner is in the atlas
+static SDL_Point sprite_atlas_position[SPRITE_COUNT];
 
 // Engine init functions
 
@@ -47,18 +26,16 @@ bool Engine::init(int resolution_width, int resolution_height, bool init_fullscr
     window = SDL_CreateWindow("Find Familiar", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 
-    int img_flags = IMG_INIT_PNG;
-
-    if(!(IMG_Init(img_flags) & img_flags)){
-        std::cout << "Unable to initialize SDL_image! SDL Error: " << IMG_GetError() << std::endl;
-        return false;
-    }
-
     if(!window || !renderer){
         std::cout << "Unable to initial engine!" << std::endl;
         return false;
     }
 
+    SDL_RendererInfo renderer_info;
+    if(SDL_GetRendererInfo(renderer, &renderer_info) == 0) {
+        is_vsynced = (renderer_info.flags & SDL_RENDERER_PRESENTVSYNC) != 0;
+    }
+
     set_resolution(resolution_width, resolution_height);
     if(init_fullscreened) {
         toggle_fullscreen();
@@ -71,46 +48,184 @@ bool Engine::init(int resolution_width, int resolution_height, bool init_fullscr
     return true;
 }
 
+// Loads sprite metadata (frame counts and sizes) without creating a window or renderer,
+// so that game states can be simulated on machines with no display
+bool Engine::init_headless() {
+    window = NULL;
+    renderer = NULL;
+
+    if(!textures_init()) {
+        return false;
+    }
+
+    return true;
+}
+
+// Renders into a screen sized surface with SDL's software renderer instead of a window, so that
+// rendering can be exercised and measured on machines with no display
+bool Engine::init_offscreen() {
+    window = NULL;
+    renderer = NULL;
+
+    offscreen_surface = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, SDL_PIXELFORMAT_RGBA32);
+    if(offscreen_surface != NULL) {
+        renderer = SDL_CreateSoftwareRenderer(offscreen_surface);
+    }
+    if(renderer == NULL) {
+        std::cout << "Unable to create offscreen renderer! SDL Error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    if(!textures_init()) {
+        return false;
+    }
+
+    return true;
+}
+
 void Engine::quit() {
     textures_free();
 
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    if(renderer != NULL) {
+        SDL_DestroyRenderer(renderer);
+    }
+    if(window != NULL) {
+        SDL_DestroyWindow(window);
+    }
+    if(offscreen_surface != NULL) {
+        SDL_FreeSurface(offscreen_surface);
+    }
 
     IMG_Quit();
     SDL_Quit();
 }
 
+// Loads the sprite atlas from the baked asset pack if there is one, otherwise decodes and packs the sprite sheets
 bool Engine::textures_init() {
-    for(int i = 0; i < SPRITE_COUNT; i++) {
-        SDL_Surface* loaded_surface = IMG_Load(sprite_data[i].path);
-        if(loaded_surface == NULL) {
-            std::cout << "Unable to load texture image! SDL Error: " << IMG_GetError() << std::endl;
+    AssetPack pack;
+    AssetPackSprite sprites[SPRITE_COUNT];
+    SDL_Surface* atlas_surface = NULL;
+
+    bool from_pack = asset_pack_open(ASSET_PACK_PATH, pack);
+    if(from_pack) {
+        memcpy(sprites, pack.sprites, sizeof(sprites));
+    } else {
+        int img_flags = IMG_INIT_PNG;
+        if(!(IMG_Init(img_flags) & img_flags)){
+            std::cout << "Unable to initialize SDL_image! SDL Error: " << IMG_GetError() << std::endl;
             return false;
         }
 
-        sprite_texture[i] = SDL_CreateTextureFromSurface(renderer, loaded_surface);
-        if(sprite_texture[i] == NULL) {
-            std::cout << "Unable to create sprite texture! SDL Error: " << SDL_GetError() << std::endl;
+        atlas_surface = assets_build_atlas(sprites);
+        if(atlas_surface == NULL) {
             return false;
         }
+    }
 
-        sprite_texture_width[i] = loaded_surface->w;
-        sprite_texture_height[i] = loaded_surface->h;
-        sprite_frame_count[i] = loaded_surface->w / sprite_data[i].frame_size[0];
+    for(int i = 0; i < SPRITE_COUNT; i++) {
+        sprite_texture_width[i] = sprites[i].width;
+        sprite_texture_height[i] = sprites[i].height;
+        sprite_frame_count[i] = sprites[i].frame_count;
+        sprite_atlas_position[i] = (SDL_Point) {
+            .x = sprites[i].atlas_x,
+            .y = sprites[i].atlas_y
+        };
+    }
+
+    // Headless engines only need the sprite metadata
+    bool success = true;
+    if(renderer != NULL) {
+        if(from_pack) {
+            atlas_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, pack.header->atlas_width, pack.header->atlas_height);
+            if(atlas_texture != NULL) {
+                SDL_UpdateTexture(atlas_texture, NULL, pack.pixels, pack.header->atlas_width * 4);
+                SDL_SetTextureBlendMode(atlas_texture, SDL_BLENDMODE_BLEND);
+            }
+        } else {
+            atlas_texture = SDL_CreateTextureFromSurface(renderer, atlas_surface);
+        }
+        if(atlas_texture == NULL) {
+            std::cout << "Unable to create sprite texture! SDL Error: " << SDL_GetError() << std::endl;
+            success = false;
+        }
+    }
 
-        SDL_FreeSurface(loaded_surface);
+    if(from_pack) {
+        asset_pack_close(pack);
+    } else {
+        SDL_FreeSurface(atlas_surface);
     }
 
-    return true;
+    return success;
 }
 
 void Engine::textures_free() {
-    for(int i = 0; i < SPRITE_COUNT; i++) {
-        SDL_DestroyTexture(sprite_texture[i]);
+    text_runs_free();
+
+    if(atlas_texture != NULL) {
+        SDL_DestroyTexture(atlas_texture);
+        atlas_texture = NULL;
     }
 }
 
+void Engine::text_runs_free() {
+    for(auto& entry : text_runs) {
+        if(entry.second.texture != NULL) {
+            SDL_DestroyTexture(entry.second.texture);
+        }
+    }
+    text_runs.clear();
+    text_run_lru.clear();
+}
+
+// Returns the cached run for the text, laying it out into a new texture if it isn't cached yet
+const TextRun* Engine::text_run_get(const char* text) {
+    // FNV-1a over the characters, with the stored text compared on a hit in case of collisions
+    uint64_t key = 1469598103934665603ULL;
+    int length = 0;
+    for(; text[length] != '\0'; length++) {
+        key = (key ^ (uint8_t)text[length]) * 1099511628211ULL;
+    }
+
+    auto cached_run = text_runs.find(key);
+    if(cached_run != text_runs.end() && cached_run->second.text == text) {
+        text_run_lru.splice(text_run_lru.begin(), text_run_lru, cached_run->second.lru_position);
+        return &cached_run->second;
+    }
+
+    // Draw whatever is queued before any texture it uses can be evicted
+    render_flush();
+    if(cached_run != text_runs.end()) {
+        SDL_DestroyTexture(cached_run->second.texture);
+        text_run_lru.erase(cached_run->second.lru_position);
+        text_runs.erase(cached_run);
+    } else if((int)text_runs.size() == MAX_CACHED_TEXT_RUNS) {
+        auto evicted_run = text_runs.find(text_run_lru.back());
+        SDL_DestroyTexture(evicted_run->second.texture);
+        text_runs.erase(evicted_run);
+        text_run_lru.pop_back();
+    }
+
+    SDL_Texture* texture = render_target_create(length * 8, 8);
+    if(texture == NULL) {
+        return NULL;
+    }
+    render_target_begin(texture);
+    for(int index = 0; index < length; index++) {
+        render_sprite_frame(SPRITE_FONT, (int)(text[index] - ' '), index * 8, 0, false);
+    }
+    render_target_end();
+
+    text_run_lru.push_front(key);
+    TextRun& run = text_runs[key];
+    run.text = text;
+    run.texture = texture;
+    run.width = length * 8;
+    run.lru_position = text_run_lru.begin();
+
+    return &run;
+}
+
 void Engine::set_resolution(int width, int height) {
     SDL_RenderSetLogicalSize(renderer, SCREEN_WIDTH, SCREEN_HEIGHT);
     SDL_SetWindowSize(window, width, height);
@@ -126,29 +241,67 @@ void Engine::toggle_fullscreen() {
     is_fullscreen = !is_fullscreen;
 }
 
-void Engine::clock_tick() {
-    frames++;
-    float current_time = SDL_GetTicks() / 1000.0f;
+void Engine::clock_init(int update_rate) {
+    clock_frequency = SDL_GetPerformanceFrequency();
+    update_duration = clock_frequency / update_rate;
+    last_frame_counter = SDL_GetPerformanceCounter();
+    last_second_counter = last_frame_counter;
+    update_accumulator = 0;
+    interpolation = 1.0f;
+}
 
-    // If one second has passed, record what the fps and dps was during that second
-    if(current_time - last_second_time >= 1.0f) {
-        fps = frames;
-        dps = deltas;
-        frames = 0;
-        deltas = 0;
-        last_second_time += 1.0;
+// Without vsync nothing else paces the loop, so this caps the frame rate rather than letting it spin
+void Engine::clock_sleep() {
+    if(is_vsynced) {
+        return;
     }
 
-    // Record the delta time for consistent game logic
-    delta = current_time - last_update_time;
-    deltas += delta;
-    last_update_time = current_time;
+    Uint64 min_frame_duration = clock_frequency / MAX_UNSYNCED_FRAME_RATE;
+    Uint64 frame_duration = SDL_GetPerformanceCounter() - last_frame_counter;
+    if(frame_duration < min_frame_duration) {
+        SDL_Delay((Uint32)(((min_frame_duration - frame_duration) * 1000) / clock_frequency));
+    }
+}
 
-    // Delay if there's extra time between frames
-    if(current_time - last_frame_time < FRAME_DURATION) {
-        unsigned long delay_time = (unsigned long)(1000.0f * (FRAME_DURATION - (current_time - last_frame_time)));
-        SDL_Delay(delay_time);
+// How long until clock_tick will have another update due, rounded up to whole milliseconds
+int Engine::clock_ms_until_update() const {
+    Uint64 elapsed = update_accumulator + (SDL_GetPerformanceCounter() - last_frame_counter);
+    if(elapsed >= update_duration) {
+        return 0;
     }
+    return (int)((((update_duration - elapsed) * 1000) + clock_frequency - 1) / clock_frequency);
+}
+
+// Call once per frame before updating. Returns how many fixed updates are due since the last frame, and sets
+// interpolation to how far the frame is between the last update and the next one.
+int Engine::clock_tick() {
+    Uint64 current_counter = SDL_GetPerformanceCounter();
+    update_accumulator += current_counter - last_frame_counter;
+    last_frame_counter = current_counter;
+
+    int due_updates = (int)std::min(update_accumulator / update_duration, (Uint64)MAX_UPDATES_PER_FRAME);
+    update_accumulator -= due_updates * update_duration;
+
+    // After a long stall, drop the time that couldn't be caught up on instead of running ever more updates
+    if(update_accumulator >= update_duration) {
+        update_accumulator %= update_duration;
+    }
+    interpolation = (float)update_accumulator / (float)update_duration;
+
+    // If one second has passed, record how many frames were presented and updates run during that second
+    updates += due_updates;
+    if(current_counter - last_second_counter >= clock_frequency) {
+        fps = frames;
+        ups = updates;
+        frames = 0;
+        updates = 0;
+        last_second_counter += clock_frequency;
+        if(current_counter - last_second_counter >= clock_frequency) {
+            last_second_counter = current_counter;
+        }
+    }
+
+    return due_updates;
 }
 
 // Animation functions
@@ -188,15 +341,107 @@ void Engine::render_clear() {
 }
 
 void Engine::render_present() {
+    render_flush();
     SDL_RenderPresent(renderer);
+    frames++;
+
+    render_draw_calls = frame_draw_calls;
+    render_quads = frame_quads;
+    frame_draw_calls = 0;
+    frame_quads = 0;
+}
+
+// Submits every queued quad, one SDL_RenderGeometry call per batch. Anything that draws to the
+// renderer directly (lines, rects, render target switches) must flush first to keep draw order
+void Engine::render_flush() {
+    for(const RenderBatch& batch : render_batches) {
+        SDL_RenderGeometry(renderer, batch.texture, &render_vertices[batch.first_vertex], batch.quad_count * 4, &render_indices[0], batch.quad_count * 6);
+        frame_draw_calls++;
+        frame_quads += batch.quad_count;
+    }
+
+    render_vertices.clear();
+    render_batches.clear();
+}
+
+SDL_Texture* Engine::render_target_create(int width, int height) {
+    SDL_Texture* target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, width, height);
+    if(target == NULL) {
+        std::cout << "Unable to create render target! SDL Error: " << SDL_GetError() << std::endl;
+        return NULL;
+    }
+    SDL_SetTextureBlendMode(target, SDL_BLENDMODE_BLEND);
+
+    return target;
+}
+
+void Engine::render_target_begin(SDL_Texture* target) {
+    render_flush();
+    SDL_SetRenderTarget(renderer, target);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+}
+
+void Engine::render_target_end() {
+    render_flush();
+    SDL_SetRenderTarget(renderer, NULL);
+}
+
+void Engine::render_queue_quad(SDL_Texture* texture, const SDL_Rect& source_rect, const SDL_Rect& dest_rect, bool flipped) {
+    // Consecutive quads from the same texture share a batch, a texture change starts a new one
+    if(render_batches.empty() || render_batches.back().texture != texture) {
+        int texture_width, texture_height;
+        SDL_QueryTexture(texture, NULL, NULL, &texture_width, &texture_height);
+        render_batches.push_back((RenderBatch) {
+            .texture = texture,
+            .texture_width = texture_width,
+            .texture_height = texture_height,
+            .first_vertex = (int)render_vertices.size(),
+            .quad_count = 0
+        });
+    }
+    RenderBatch& batch = render_batches.back();
+    batch.quad_count++;
+
+    // Every quad uses the same index pattern relative to its batch, so the index buffer only grows
+    if((int)render_indices.size() < batch.quad_count * 6) {
+        int base = (batch.quad_count - 1) * 4;
+        const int quad_indices[6] = { 0, 1, 2, 2, 1, 3 };
+        for(int i = 0; i < 6; i++) {
+            render_indices.push_back(base + quad_indices[i]);
+        }
+    }
+
+    float u0 = (float)source_rect.x / batch.texture_width;
+    float v0 = (float)source_rect.y / batch.texture_height;
+    float u1 = (float)(source_rect.x + source_rect.w) / batch.texture_width;
+    float v1 = (float)(source_rect.y + source_rect.h) / batch.texture_height;
+    if(flipped) {
+        float swap = u0;
+        u0 = u1;
+        u1 = swap;
+    }
+
+    float x0 = (float)dest_rect.x;
+    float y0 = (float)dest_rect.y;
+    float x1 = (float)(dest_rect.x + dest_rect.w);
+    float y1 = (float)(dest_rect.y + dest_rect.h);
+    const SDL_Color color = (SDL_Color) { .r = 255, .g = 255, .b = 255, .a = 255 };
+
+    render_vertices.push_back((SDL_Vertex) { .position = { x0, y0 }, .color = color, .tex_coord = { u0, v0 } });
+    render_vertices.push_back((SDL_Vertex) { .position = { x1, y0 }, .color = color, .tex_coord = { u1, v0 } });
+    render_vertices.push_back((SDL_Vertex) { .position = { x0, y1 }, .color = color, .tex_coord = { u0, v1 } });
+    render_vertices.push_back((SDL_Vertex) { .position = { x1, y1 }, .color = color, .tex_coord = { u1, v1 } });
 }
 
 void Engine::render_text(const char* text, int x, int y) {
-    int index = 0;
-    while(text[index] != '\0') {
-        int letter_index = (int)(text[index] - ' ');
-        render_sprite_frame(SPRITE_FONT, letter_index, x + (index * 8), y, false);
-        index++;
+    if(text[0] == '\0') {
+        return;
+    }
+
+    const TextRun* run = text_run_get(text);
+    if(run != NULL) {
+        render_texture(run->texture, x, y, run->width, 8);
     }
 }
 
@@ -241,8 +486,8 @@ void Engine::render_dialog(char* dialog_rows[2], size_t dialog_display_length) {
 
 void Engine::render_sprite(Sprite sprite, int x, int y) {
     SDL_Rect source_rect = (SDL_Rect) {
-        .x = 0,
-        .y = 0,
+        .x = sprite_atlas_position[sprite].x,
+        .y = sprite_atlas_position[sprite].y,
         .w = sprite_texture_width[sprite],
         .h = sprite_texture_height[sprite]
     };
@@ -252,14 +497,30 @@ void Engine::render_sprite(Sprite sprite, int x, int y) {
         .w = source_rect.w,
         .h = source_rect.h
     };
-    SDL_RenderCopy(renderer, sprite_texture[sprite], &source_rect, &dest_rect);
+    render_queue_quad(atlas_texture, source_rect, dest_rect, false);
+}
+
+void Engine::render_texture(SDL_Texture* texture, int x, int y, int width, int height) {
+    SDL_Rect source_rect = (SDL_Rect) {
+        .x = 0,
+        .y = 0,
+        .w = width,
+        .h = height
+    };
+    SDL_Rect dest_rect = (SDL_Rect) {
+        .x = x,
+        .y = y,
+        .w = width,
+        .h = height
+    };
+    render_queue_quad(texture, source_rect, dest_rect, false);
 }
 
 void Engine::render_sprite_frame(Sprite sprite, int frame, int x, int y, bool flipped) {
     int frame_long_x = sprite_data[sprite].frame_size[0] * frame;
     SDL_Rect source_rect = (SDL_Rect) {
-        .x = frame_long_x % sprite_texture_width[sprite],
-        .y = ((int)(frame_long_x / sprite_texture_width[sprite])) * sprite_data[sprite].frame_size[1],
+        .x = sprite_atlas_position[sprite].x + (frame_long_x % sprite_texture_width[sprite]),
+        .y = sprite_atlas_position[sprite].y + ((int)(frame_long_x / sprite_texture_width[sprite])) * sprite_data[sprite].frame_size[1],
         .w = sprite_data[sprite].frame_size[0],
         .h = sprite_data[sprite].frame_size[1]
     };
@@ -270,14 +531,7 @@ void Engine::render_sprite_frame(Sprite sprite, int frame, int x, int y, bool fl
         .h = source_rect.h
     };
 
-    SDL_RendererFlip flip;
-    if(flipped) {
-        flip = SDL_FLIP_HORIZONTAL;
-    } else {
-        flip = SDL_FLIP_NONE;
-    }
-
-    SDL_RenderCopyEx(renderer, sprite_texture[sprite], &source_rect, &dest_rect, 0, NULL, flip);
+    render_queue_quad(atlas_texture, source_rect, dest_rect, flipped);
 }
 
 void Engine::render_animation(Animation animation, int x, int y) {
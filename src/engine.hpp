@@ -1,6 +1,11 @@
 #pragma once
 
 #include <SDL2/SDL.h>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <vector>
+#include <unordered_map>
 
 typedef enum Sprite {
     SPRITE_FONT,
@@ -35,22 +40,87 @@ typedef struct Animation {
     }
 } Animation;
 
+// Builds HUD strings in a fixed buffer, so that formatting numbers every frame doesn't allocate
+typedef struct TextBuffer {
+    static constexpr int CAPACITY = 64;
+    char text[CAPACITY];
+    int length;
+    inline void clear() {
+        length = 0;
+        text[0] = '\0';
+    }
+    inline void append(const char* value) {
+        while(*value != '\0' && length < CAPACITY - 1) {
+            text[length++] = *value++;
+        }
+        text[length] = '\0';
+    }
+    inline void append_int(int value) {
+        char digits[12];
+        int digit_count = 0;
+        unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+        do {
+            digits[digit_count++] = (char)('0' + (magnitude % 10));
+            magnitude /= 10;
+        } while(magnitude != 0);
+        if(value < 0) {
+            digits[digit_count++] = '-';
+        }
+        while(digit_count != 0 && length < CAPACITY - 1) {
+            text[length++] = digits[--digit_count];
+        }
+        text[length] = '\0';
+    }
+} TextBuffer;
+
+// A string laid out once into its own texture, so drawing it again is a single quad
+typedef struct TextRun {
+    std::string text;
+    SDL_Texture* texture;
+    int width;
+    std::list<uint64_t>::iterator lru_position;
+} TextRun;
+
+typedef struct RenderBatch {
+    SDL_Texture* texture;
+    int texture_width;
+    int texture_height;
+    int first_vertex;
+    int quad_count;
+} RenderBatch;
+
 class Engine {
     public:
         static const int SCREEN_WIDTH = 160;
         static const int SCREEN_HEIGHT = 144;
         static const int TILE_SIZE = 16;
+        static const int DEFAULT_UPDATE_RATE = 60;
+        static const int MAX_UPDATES_PER_FRAME = 8;
+        static const int MAX_UNSYNCED_FRAME_RATE = 240;
+        static constexpr int MAX_CACHED_TEXT_RUNS = 64;
+        static constexpr int ATLAS_WIDTH = 256;
+        static constexpr int ATLAS_PADDING = 1;
 
         int fps = 0;
+        int ups = 0;
+        // How far the current frame is between the last update and the next one, from 0 to 1
+        float interpolation = 1.0f;
+        int render_draw_calls = 0;
+        int render_quads = 0;
 
         SDL_Window* window;
         SDL_Renderer* renderer;
 
         bool init(int resolution_width, int resolution_height, bool init_fullscreened);
+        bool init_headless();
+        bool init_offscreen();
         void quit();
         void set_resolution(int width, int height);
         void toggle_fullscreen();
-        void clock_tick();
+        void clock_init(int update_rate);
+        void clock_sleep();
+        int clock_tick();
+        int clock_ms_until_update() const;
 
         Animation animation_init(Sprite sprite, int frame_duration) const;
         void animation_update(Animation& animation) const;
@@ -58,27 +128,52 @@ class Engine {
 
         void render_clear();
         void render_present();
+        void render_flush();
+
+        SDL_Texture* render_target_create(int width, int height);
+        void render_target_begin(SDL_Texture* target);
+        void render_target_end();
 
         void render_text(const char* text, int x, int y);
         void render_dialog(char* dialog_rows[2], size_t dialog_display_length);
 
         void render_sprite(Sprite sprite, int x, int y);
+        void render_texture(SDL_Texture* texture, int x, int y, int width, int height);
         void render_sprite_frame(Sprite sprite, int frame, int x, int y, bool flipped);
         void render_animation(Animation animation, int x, int y);
         void render_actor_animation(Animation animation, int direction, int x, int y);
     private:
         bool is_fullscreen = false;
 
-        float last_frame_time = 0.0f;
-        float last_update_time = 0.0f;
-        float last_second_time = 0.0f;
+        bool is_vsynced = false;
+        // The surface an offscreen engine renders into in place of a window
+        SDL_Surface* offscreen_surface = NULL;
+
+        Uint64 clock_frequency = 1;
+        Uint64 update_duration = 1;
+        Uint64 last_frame_counter = 0;
+        Uint64 last_second_counter = 0;
+        Uint64 update_accumulator = 0;
         int frames = 0;
-        float deltas = 0.0f;
-        float delta = 0.0f;
-        float dps = 0.0f;
+        int updates = 0;
+
+        // Every sprite sheet is packed into this one texture, so sprites never break a batch
+        SDL_Texture* atlas_texture = NULL;
 
-        SDL_Texture* sprite_texture[SPRITE_COUNT];
+        std::unordered_map<uint64_t, TextRun> text_runs;
+        std::list<uint64_t> text_run_lru;
+
+        std::vector<SDL_Vertex> render_vertices;
+        std::vector<int> render_indices;
+        std::vector<RenderBatch> render_batches;
+        int frame_draw_calls = 0;
+        int frame_quads = 0;
+
+        void render_queue_quad(SDL_Texture* texture, const SDL_Rect& source_rect, const SDL_Rect& dest_rect, bool flipped);
 
         bool textures_init();
         void textures_free();
+
+        const TextRun* text_run_get(const char* text);
+        void text_runs_free();
 };
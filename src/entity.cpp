@@ -0,0 +1,346 @@
+#include "entity.hpp"
+
+#include <algorithm>
+#include <utility>
+
+template<typename T>
+static void column_remove(std::vector<T>& column, int index) {
+    column[index] = std::move(column.back());
+    column.pop_back();
+}
+
+// Entity index functions
+
+EntityHandle EntityIndex::create() {
+    int slot;
+    if(free_slots.empty()) {
+        slot = (int)slot_index.size();
+        slot_index.push_back(0);
+        slot_generation.push_back(0);
+    } else {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    }
+
+    slot_index[slot] = count;
+    index_slot.push_back(slot);
+    count++;
+
+    return (EntityHandle) {
+        .slot = slot,
+        .generation = slot_generation[slot]
+    };
+}
+
+// Returns the dense index the entity occupied, which now holds what used to be the last entity
+int EntityIndex::remove(EntityHandle handle) {
+    int index = index_of(handle);
+    if(index == -1) {
+        return -1;
+    }
+
+    int last_slot = index_slot[count - 1];
+    index_slot[index] = last_slot;
+    slot_index[last_slot] = index;
+    index_slot.pop_back();
+    count--;
+
+    slot_generation[handle.slot]++;
+    free_slots.push_back(handle.slot);
+
+    return index;
+}
+
+int EntityIndex::index_of(EntityHandle handle) const {
+    if(handle.slot < 0 || handle.slot >= (int)slot_index.size() || slot_generation[handle.slot] != handle.generation) {
+        return -1;
+    }
+    return slot_index[handle.slot];
+}
+
+EntityHandle EntityIndex::handle_at(int index) const {
+    int slot = index_slot[index];
+    return (EntityHandle) {
+        .slot = slot,
+        .generation = slot_generation[slot]
+    };
+}
+
+void EntityIndex::snapshot_write(SnapshotWriter& writer) const {
+    writer.write_value(count);
+    writer.write_column(slot_index);
+    writer.write_column(slot_generation);
+    writer.write_column(index_slot);
+    writer.write_column(free_slots);
+}
+
+void EntityIndex::snapshot_read(SnapshotReader& reader) {
+    reader.read_value(count);
+    reader.read_column(slot_index);
+    reader.read_column(slot_generation);
+    reader.read_column(index_slot);
+    reader.read_column(free_slots);
+    if(reader.failed() || count < 0 || index_slot.size() != (size_t)count || slot_generation.size() != slot_index.size() ||
+       free_slots.size() + count != slot_index.size()) {
+        reader.fail();
+        return;
+    }
+
+    // Every slot must either hold exactly one live entity that points back at it, or be free exactly once
+    std::vector<char> slot_used(slot_index.size(), 0);
+    for(int i = 0; i < count; i++) {
+        int slot = index_slot[i];
+        if(slot < 0 || slot >= (int)slot_index.size() || slot_index[slot] != i || slot_used[slot]) {
+            reader.fail();
+            return;
+        }
+        slot_used[slot] = 1;
+    }
+    for(int slot : free_slots) {
+        if(slot < 0 || slot >= (int)slot_index.size() || slot_used[slot]) {
+            reader.fail();
+            return;
+        }
+        slot_used[slot] = 1;
+    }
+}
+
+// Actor store functions
+
+EntityHandle ActorStore::spawn(Sprite sprite, vec2 spawn_position) {
+    EntityHandle handle = index.create();
+
+    position.push_back(spawn_position);
+    previous_position.push_back(spawn_position);
+    target.push_back(vec2_null());
+    facing_direction.push_back(2);
+    animation.push_back((Animation) {
+        .sprite = sprite,
+        .frame = 0,
+        .timer = 0,
+        .frame_duration = 10
+    });
+    npc.push_back(entity_handle_null());
+    bucket.push_back(0);
+
+    return handle;
+}
+
+void ActorStore::despawn(EntityHandle handle) {
+    int removed = index.remove(handle);
+    if(removed == -1) {
+        return;
+    }
+
+    column_remove(position, removed);
+    column_remove(previous_position, removed);
+    column_remove(target, removed);
+    column_remove(facing_direction, removed);
+    column_remove(animation, removed);
+    column_remove(npc, removed);
+    column_remove(bucket, removed);
+}
+
+void ActorStore::snapshot_write(SnapshotWriter& writer) const {
+    index.snapshot_write(writer);
+    writer.write_column(position);
+    writer.write_column(previous_position);
+    writer.write_column(target);
+    writer.write_column(facing_direction);
+    writer.write_column(animation);
+    writer.write_column(npc);
+}
+
+void ActorStore::snapshot_read(SnapshotReader& reader) {
+    index.snapshot_read(reader);
+    reader.read_column(position);
+    reader.read_column(previous_position);
+    reader.read_column(target);
+    reader.read_column(facing_direction);
+    reader.read_column(animation);
+    reader.read_column(npc);
+    if(reader.failed()) {
+        return;
+    }
+
+    size_t actor_count = (size_t)count();
+    if(position.size() != actor_count || previous_position.size() != actor_count || target.size() != actor_count ||
+       facing_direction.size() != actor_count || animation.size() != actor_count || npc.size() != actor_count) {
+        reader.fail();
+        return;
+    }
+    for(size_t i = 0; i < actor_count; i++) {
+        if(facing_direction[i] < 0 || facing_direction[i] > 3 || animation[i].sprite < 0 || animation[i].sprite >= SPRITE_COUNT ||
+           animation[i].frame_duration <= 0) {
+            reader.fail();
+            return;
+        }
+    }
+    bucket.assign(actor_count, 0);
+}
+
+// NPC store functions
+
+EntityHandle NPCStore::spawn(EntityHandle actor_handle, int npc_dialog, const PathNode* path, int length) {
+    EntityHandle handle = index.create();
+
+    actor.push_back(actor_handle);
+    path_index.push_back(0);
+    path_timer.push_back(0);
+    path_start.push_back((int)path_nodes.size());
+    path_length.push_back(length);
+    dialog.push_back(npc_dialog);
+    route.push_back(std::vector<uint8_t>());
+    route_node.push_back(-1);
+    route_revision.push_back(0);
+    route_retry.push_back(0);
+    route_failures.push_back(0);
+    path_nodes.insert(path_nodes.end(), path, path + length);
+    for(int i = 0; i < length; i++) {
+        path_nodes[path_nodes.size() - length + i].unreachable_revision = -1;
+    }
+
+    return handle;
+}
+
+void NPCStore::despawn(EntityHandle handle) {
+    int removed = index.remove(handle);
+    if(removed == -1) {
+        return;
+    }
+
+    path_garbage += path_length[removed];
+
+    column_remove(actor, removed);
+    column_remove(path_index, removed);
+    column_remove(path_timer, removed);
+    column_remove(path_start, removed);
+    column_remove(path_length, removed);
+    column_remove(dialog, removed);
+    column_remove(route, removed);
+    column_remove(route_node, removed);
+    column_remove(route_revision, removed);
+    column_remove(route_retry, removed);
+    column_remove(route_failures, removed);
+
+    if(path_garbage * 2 > (int)path_nodes.size()) {
+        paths_compact();
+    }
+}
+
+void NPCStore::paths_compact() {
+    std::vector<PathNode> compacted;
+    compacted.reserve(path_nodes.size() - path_garbage);
+    for(int i = 0; i < count(); i++) {
+        int start = (int)compacted.size();
+        compacted.insert(compacted.end(), path_nodes.begin() + path_start[i], path_nodes.begin() + path_start[i] + path_length[i]);
+        path_start[i] = start;
+    }
+
+    path_nodes.swap(compacted);
+    path_garbage = 0;
+}
+
+// Keeps the routes and unreachable nodes that were current when a snapshot was saved current after it is
+// restored, and marks every other one stale
+void NPCStore::wall_revision_rebase(int saved_revision, int revision) {
+    for(int& route_wall_revision : route_revision) {
+        route_wall_revision = route_wall_revision == saved_revision ? revision : -1;
+    }
+    for(PathNode& node : path_nodes) {
+        node.unreachable_revision = node.unreachable_revision == saved_revision ? revision : -1;
+    }
+}
+
+void NPCStore::snapshot_write(SnapshotWriter& writer) const {
+    index.snapshot_write(writer);
+    writer.write_column(actor);
+    writer.write_column(path_index);
+    writer.write_column(path_timer);
+    writer.write_column(path_start);
+    writer.write_column(path_length);
+    writer.write_column(dialog);
+    writer.write_column(path_nodes);
+    writer.write_value(path_garbage);
+
+    // Routes are saved as their lengths, then all of their steps back to back
+    std::vector<int> route_lengths;
+    std::vector<uint8_t> route_steps;
+    for(const std::vector<uint8_t>& steps : route) {
+        route_lengths.push_back((int)steps.size());
+        route_steps.insert(route_steps.end(), steps.begin(), steps.end());
+    }
+    writer.write_column(route_lengths);
+    writer.write_column(route_steps);
+    writer.write_column(route_node);
+    writer.write_column(route_revision);
+    writer.write_column(route_retry);
+    writer.write_column(route_failures);
+}
+
+void NPCStore::snapshot_read(SnapshotReader& reader) {
+    index.snapshot_read(reader);
+    reader.read_column(actor);
+    reader.read_column(path_index);
+    reader.read_column(path_timer);
+    reader.read_column(path_start);
+    reader.read_column(path_length);
+    reader.read_column(dialog);
+    reader.read_column(path_nodes);
+    reader.read_value(path_garbage);
+
+    std::vector<int> route_lengths;
+    std::vector<uint8_t> route_steps;
+    reader.read_column(route_lengths);
+    reader.read_column(route_steps);
+    reader.read_column(route_node);
+    reader.read_column(route_revision);
+    reader.read_column(route_retry);
+    reader.read_column(route_failures);
+    if(reader.failed()) {
+        return;
+    }
+
+    size_t npc_count = (size_t)count();
+    if(actor.size() != npc_count || path_index.size() != npc_count || path_timer.size() != npc_count ||
+       path_start.size() != npc_count || path_length.size() != npc_count || dialog.size() != npc_count ||
+       route_lengths.size() != npc_count || route_node.size() != npc_count || route_revision.size() != npc_count ||
+       route_retry.size() != npc_count || route_failures.size() != npc_count ||
+       path_garbage < 0 || (size_t)path_garbage > path_nodes.size()) {
+        reader.fail();
+        return;
+    }
+
+    // Each path has to lie within the pool, and everything indexing a path has to lie within it
+    for(size_t i = 0; i < npc_count; i++) {
+        if(path_start[i] < 0 || path_length[i] < 0 || (size_t)path_start[i] + (size_t)path_length[i] > path_nodes.size() ||
+           path_index[i] < 0 || path_index[i] >= std::max(path_length[i], 1) ||
+           route_node[i] < -1 || route_node[i] >= path_length[i] || route_retry[i] < 0 || route_failures[i] < 0) {
+            reader.fail();
+            return;
+        }
+    }
+    for(const PathNode& node : path_nodes) {
+        if(node.wait_direction < 0 || node.wait_direction > 3) {
+            reader.fail();
+            return;
+        }
+    }
+    for(uint8_t direction : route_steps) {
+        if(direction > 3) {
+            reader.fail();
+            return;
+        }
+    }
+
+    route.assign(npc_count, std::vector<uint8_t>());
+    size_t step = 0;
+    for(size_t i = 0; i < npc_count; i++) {
+        if(route_lengths[i] < 0 || (size_t)route_lengths[i] > route_steps.size() - step) {
+            reader.fail();
+            return;
+        }
+        route[i].assign(route_steps.begin() + step, route_steps.begin() + step + route_lengths[i]);
+        step += route_lengths[i];
+    }
+}
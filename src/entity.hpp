@@ -0,0 +1,121 @@
+#pragma once
+
+#include "engine.hpp"
+#include "vector.hpp"
+#include "snapshot.hpp"
+#include <cstdint>
+#include <vector>
+
+typedef struct EntityHandle {
+    int slot;
+    int generation;
+    bool equals(const EntityHandle& other) const {
+        return slot == other.slot && generation == other.generation;
+    }
+    bool is_null() const {
+        return slot == -1;
+    }
+} EntityHandle;
+
+static inline EntityHandle entity_handle_null() {
+    return (EntityHandle) {
+        .slot = -1,
+        .generation = 0
+    };
+}
+
+// Hands out stable handles for entities whose data lives in densely packed arrays. Removing an entity
+// moves the last entity into its place, and the slot table keeps handles pointing at the right index.
+class EntityIndex {
+    public:
+        int count = 0;
+
+        EntityHandle create();
+        int remove(EntityHandle handle);
+        int index_of(EntityHandle handle) const;
+        EntityHandle handle_at(int index) const;
+
+        void snapshot_write(SnapshotWriter& writer) const;
+        void snapshot_read(SnapshotReader& reader);
+    private:
+        std::vector<int> slot_index;
+        std::vector<int> slot_generation;
+        std::vector<int> index_slot;
+        std::vector<int> free_slots;
+};
+
+typedef struct PathNode {
+    vec2 position;
+    int wait_time;
+    int wait_direction;
+    // Wall revision the node was last found to be unreachable at, or -1. Reset whenever an NPC spawns.
+    int unreachable_revision;
+} PathNode;
+
+// Every column is indexed by the actor's dense index
+class ActorStore {
+    public:
+        EntityIndex index;
+        std::vector<vec2> position;
+        // Where the actor was at the start of the current tick, so rendering can interpolate between ticks
+        std::vector<vec2> previous_position;
+        std::vector<vec2> target;
+        std::vector<int> facing_direction;
+        std::vector<Animation> animation;
+        std::vector<EntityHandle> npc;
+        // Key of the render bucket the world has filed the actor under. Not saved in snapshots.
+        std::vector<uint64_t> bucket;
+
+        int count() const {
+            return index.count;
+        }
+
+        EntityHandle spawn(Sprite sprite, vec2 spawn_position);
+        void despawn(EntityHandle handle);
+
+        void snapshot_write(SnapshotWriter& writer) const;
+        void snapshot_read(SnapshotReader& reader);
+};
+
+// Every column is indexed by the NPC's dense index. Paths live back to back in path_nodes, with
+// despawned paths left as garbage until they make up half of the pool. Each NPC also keeps the A* route
+// it is following towards its current path node, so it only searches again when that route goes stale.
+class NPCStore {
+    public:
+        EntityIndex index;
+        std::vector<EntityHandle> actor;
+        std::vector<int> path_index;
+        std::vector<int> path_timer;
+        std::vector<int> path_start;
+        std::vector<int> path_length;
+        // Ids of messages in the world's dialog table
+        std::vector<int> dialog;
+        // Directions of the steps left on the route, next step last, towards path node route_node as the walls
+        // were at route_revision
+        std::vector<std::vector<uint8_t>> route;
+        std::vector<int> route_node;
+        std::vector<int> route_revision;
+        // Ticks to hold still before searching again, and how many times in a row the NPC has been blocked
+        std::vector<int> route_retry;
+        std::vector<int> route_failures;
+        std::vector<PathNode> path_nodes;
+
+        int count() const {
+            return index.count;
+        }
+
+        EntityHandle spawn(EntityHandle actor_handle, int npc_dialog, const PathNode* path, int length);
+        void despawn(EntityHandle handle);
+        inline const PathNode& path_node(int npc, int node) const {
+            return path_nodes[path_start[npc] + node];
+        }
+
+        void wall_revision_rebase(int saved_revision, int revision);
+
+        void snapshot_write(SnapshotWriter& writer) const;
+        void snapshot_read(SnapshotReader& reader);
+    private:
+        int path_garbage = 0;
+
+        void paths_compact();
+};
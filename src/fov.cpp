@@ -0,0 +1,268 @@
+#include "fov.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+// A row of tiles at one depth from the origin in one quadrant, between two slopes kept as fractions
+typedef struct ShadowRow {
+    int depth;
+    int start_numerator;
+    int start_denominator;
+    int end_numerator;
+    int end_denominator;
+} ShadowRow;
+
+static inline int floor_div(int numerator, int denominator) {
+    return numerator >= 0 ? numerator / denominator : -((-numerator + denominator - 1) / denominator);
+}
+
+// Quadrants look up, right, down and left, with columns running across them
+static inline vec2 quadrant_offset(int quadrant, int depth, int col) {
+    switch(quadrant) {
+        case 0:
+            return vec2(col, -depth);
+        case 1:
+            return vec2(depth, col);
+        case 2:
+            return vec2(col, depth);
+        default:
+            return vec2(-depth, col);
+    }
+}
+
+static inline bool in_sight_range(vec2 offset) {
+    return (offset.x * offset.x) + (offset.y * offset.y) <= (FieldOfView::RADIUS * FieldOfView::RADIUS) + FieldOfView::RADIUS;
+}
+
+// Scans a row and every row visible past it, revealing walls that light reaches and floor tiles whose centres lie
+// within the light. Walls split the light into narrower rows further out.
+template<typename IsWall, typename Reveal>
+static void scan_row(int quadrant, ShadowRow row, int max_depth, const IsWall& is_wall, const Reveal& reveal) {
+    if(row.depth > max_depth) {
+        return;
+    }
+
+    // Columns whose centres lie between the slopes, rounding ties outwards
+    int min_col = floor_div((2 * row.depth * row.start_numerator) + row.start_denominator, 2 * row.start_denominator);
+    int max_col = -floor_div(row.end_denominator - (2 * row.depth * row.end_numerator), 2 * row.end_denominator);
+    int previous = -1;
+    for(int col = min_col; col <= max_col; col++) {
+        vec2 offset = quadrant_offset(quadrant, row.depth, col);
+        bool wall = is_wall(offset);
+        bool symmetric = col * row.start_denominator >= row.depth * row.start_numerator &&
+                         col * row.end_denominator <= row.depth * row.end_numerator;
+        if((wall || symmetric) && in_sight_range(offset)) {
+            reveal(offset);
+        }
+
+        if(previous == 1 && !wall) {
+            row.start_numerator = (2 * col) - 1;
+            row.start_denominator = 2 * row.depth;
+        }
+        if(previous == 0 && wall) {
+            ShadowRow next = row;
+            next.depth++;
+            next.end_numerator = (2 * col) - 1;
+            next.end_denominator = 2 * row.depth;
+            scan_row(quadrant, next, max_depth, is_wall, reveal);
+        }
+        previous = wall;
+    }
+
+    if(previous == 0) {
+        row.depth++;
+        scan_row(quadrant, row, max_depth, is_wall, reveal);
+    }
+}
+
+static const ShadowRow FIRST_ROW = (ShadowRow) {
+    .depth = 1,
+    .start_numerator = -1,
+    .start_denominator = 1,
+    .end_numerator = 1,
+    .end_denominator = 1
+};
+
+FieldOfView::FieldOfView() {
+    origin = vec2(0, 0);
+    revision = 0;
+    valid = false;
+    wall_revision = 0;
+}
+
+// Recomputes the field if the origin has moved or the walls around it have changed. Returns whether it did.
+bool FieldOfView::update(const Map& map, vec2 new_origin) {
+    if(valid && new_origin.equals(origin)) {
+        if(map.wall_revision == wall_revision) {
+            return false;
+        }
+
+        // Walls changed somewhere, but only changes inside the window change what can be seen
+        uint32_t rows[WINDOW_SIZE];
+        read_walls(map, origin - vec2(RADIUS, RADIUS), rows);
+        wall_revision = map.wall_revision;
+        if(memcmp(rows, window_walls, sizeof(rows)) == 0) {
+            return false;
+        }
+        memcpy(window_walls, rows, sizeof(rows));
+    } else {
+        origin = new_origin;
+        wall_revision = map.wall_revision;
+        read_walls(map, origin - vec2(RADIUS, RADIUS), window_walls);
+    }
+
+    valid = true;
+    compute();
+    revision++;
+
+    return true;
+}
+
+void FieldOfView::invalidate() {
+    valid = false;
+}
+
+bool FieldOfView::is_visible(vec2 tile) const {
+    vec2 offset = tile - origin;
+    if(!valid || abs(offset.x) > RADIUS || abs(offset.y) > RADIUS) {
+        return false;
+    }
+    return visible[((offset.y + RADIUS) * WINDOW_SIZE) + offset.x + RADIUS];
+}
+
+// Checks whether two tiles can see each other, scanning only the quadrants holding the target and only as
+// far out as it is, against the map's walls directly
+bool FieldOfView::line_of_sight(const Map& map, vec2 from, vec2 to) {
+    vec2 offset = to - from;
+    if(offset.x == 0 && offset.y == 0) {
+        return true;
+    }
+    if(!in_sight_range(offset)) {
+        return false;
+    }
+
+    auto is_wall = [&map, from](vec2 wall_offset) {
+        vec2 tile = from + wall_offset;
+        return tile.x < 0 || tile.y < 0 || tile.x >= map.width || tile.y >= map.height || map.get_wall(tile);
+    };
+    bool seen = false;
+    auto reveal = [&seen, offset](vec2 revealed_offset) {
+        seen = seen || revealed_offset.equals(offset);
+    };
+
+    // Tiles on a diagonal or an axis are in more than one quadrant
+    for(int quadrant = 0; quadrant < 4 && !seen; quadrant++) {
+        int depth = quadrant == 0 ? -offset.y : quadrant == 1 ? offset.x : quadrant == 2 ? offset.y : -offset.x;
+        int col = (quadrant % 2 == 0) ? offset.x : offset.y;
+        if(depth > 0 && abs(col) <= depth) {
+            scan_row(quadrant, FIRST_ROW, depth, is_wall, reveal);
+        }
+    }
+
+    return seen;
+}
+
+// Copies the walls of the window whose top left tile is window_origin, one row per word
+void FieldOfView::read_walls(const Map& map, vec2 window_origin, uint32_t* rows) const {
+    const uint32_t window_mask = ((uint32_t)1 << WINDOW_SIZE) - 1;
+    int first_x = std::max(window_origin.x, 0);
+    int last_x = std::min(window_origin.x + WINDOW_SIZE, map.width) - 1;
+    for(int row = 0; row < WINDOW_SIZE; row++) {
+        int y = window_origin.y + row;
+        rows[row] = window_mask;
+        if(y < 0 || y >= map.height || first_x > last_x) {
+            continue;
+        }
+
+        int count = (last_x - first_x) + 1;
+        int shift = first_x - window_origin.x;
+        uint32_t inside_mask = (((uint32_t)1 << count) - 1) << shift;
+        rows[row] = (rows[row] & ~inside_mask) | ((uint32_t)map.wall_bits(y, first_x, count) << shift);
+    }
+}
+
+void FieldOfView::compute() {
+    auto is_wall = [this](vec2 offset) {
+        return ((window_walls[offset.y + RADIUS] >> (offset.x + RADIUS)) & 1) != 0;
+    };
+    auto reveal = [this](vec2 offset) {
+        visible[((offset.y + RADIUS) * WINDOW_SIZE) + offset.x + RADIUS] = true;
+    };
+
+    memset(visible, 0, sizeof(visible));
+    reveal(vec2(0, 0));
+    for(int quadrant = 0; quadrant < 4; quadrant++) {
+        scan_row(quadrant, FIRST_ROW, RADIUS, is_wall, reveal);
+    }
+}
+
+// Explored map functions
+
+static inline uint64_t explored_block_key(vec2 tile) {
+    return ((uint64_t)(uint32_t)(tile.y / ExploredMap::BLOCK_SIZE) << 32) | (uint32_t)(tile.x / ExploredMap::BLOCK_SIZE);
+}
+
+void ExploredMap::clear() {
+    blocks.clear();
+}
+
+void ExploredMap::mark_visible(const FieldOfView& fov) {
+    uint64_t block_key = 0;
+    std::vector<uint64_t>* block = NULL;
+    for(int y = fov.origin.y - FieldOfView::RADIUS; y <= fov.origin.y + FieldOfView::RADIUS; y++) {
+        for(int x = fov.origin.x - FieldOfView::RADIUS; x <= fov.origin.x + FieldOfView::RADIUS; x++) {
+            vec2 tile = vec2(x, y);
+            if(x < 0 || y < 0 || !fov.is_visible(tile)) {
+                continue;
+            }
+
+            // Neighbouring tiles are nearly always in the same block as the last one
+            if(block == NULL || explored_block_key(tile) != block_key) {
+                block_key = explored_block_key(tile);
+                block = &blocks[block_key];
+                if(block->empty()) {
+                    block->assign(BLOCK_SIZE, 0);
+                }
+            }
+            (*block)[y % BLOCK_SIZE] |= (uint64_t)1 << (x % BLOCK_SIZE);
+        }
+    }
+}
+
+bool ExploredMap::is_explored(vec2 tile) const {
+    if(tile.x < 0 || tile.y < 0) {
+        return false;
+    }
+    auto block = blocks.find(explored_block_key(tile));
+    if(block == blocks.end()) {
+        return false;
+    }
+    return ((block->second[tile.y % BLOCK_SIZE] >> (tile.x % BLOCK_SIZE)) & 1) != 0;
+}
+
+void ExploredMap::snapshot_write(SnapshotWriter& writer) const {
+    writer.write_value((uint32_t)blocks.size());
+    for(const auto& block : blocks) {
+        writer.write_value(block.first);
+        writer.write_array(block.second.data(), BLOCK_SIZE);
+    }
+}
+
+void ExploredMap::snapshot_read(SnapshotReader& reader) {
+    blocks.clear();
+
+    uint32_t block_count = 0;
+    reader.read_value(block_count);
+    if(reader.failed() || (size_t)block_count * BLOCK_SIZE * sizeof(uint64_t) > reader.remaining()) {
+        reader.fail();
+        return;
+    }
+    for(uint32_t i = 0; i < block_count && !reader.failed(); i++) {
+        uint64_t block_key = 0;
+        reader.read_value(block_key);
+        std::vector<uint64_t>& block = blocks[block_key];
+        block.assign(BLOCK_SIZE, 0);
+        reader.read_array(block.data(), BLOCK_SIZE);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "map.hpp"
+#include "vector.hpp"
+#include "snapshot.hpp"
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+// What can be seen from an origin tile, found by symmetric shadowcasting over the map's walls out to RADIUS
+// tiles. Floor tiles are only seen from tiles they can see back, so the same scan answers line of sight
+// between any two tiles either way round. The walls around the origin are copied into a window when the
+// field is computed, and the field is only recomputed once the origin moves or the walls in that window change.
+class FieldOfView {
+    public:
+        static constexpr int RADIUS = 8;
+        static constexpr int WINDOW_SIZE = (RADIUS * 2) + 1;
+
+        vec2 origin;
+        // Incremented whenever the visible tiles are recomputed
+        int revision;
+
+        FieldOfView();
+
+        bool update(const Map& map, vec2 new_origin);
+        void invalidate();
+        bool is_visible(vec2 tile) const;
+
+        static bool line_of_sight(const Map& map, vec2 from, vec2 to);
+    private:
+        bool valid;
+        int wall_revision;
+        // One bit per window cell, set for walls and for cells outside the map
+        uint32_t window_walls[WINDOW_SIZE];
+        bool visible[WINDOW_SIZE * WINDOW_SIZE];
+
+        void read_walls(const Map& map, vec2 window_origin, uint32_t* rows) const;
+        void compute();
+};
+
+// Every tile that has ever been visible, kept as BLOCK_SIZE square bitsets that are only allocated once
+// something in them is seen, so the parts of huge maps that were never visited cost nothing
+class ExploredMap {
+    public:
+        static constexpr int BLOCK_SIZE = 64;
+
+        void clear();
+        void mark_visible(const FieldOfView& fov);
+        bool is_explored(vec2 tile) const;
+
+        void snapshot_write(SnapshotWriter& writer) const;
+        void snapshot_read(SnapshotReader& reader);
+    private:
+        // One word per block row, keyed by the block's y in the high half and its x in the low half
+        std::unordered_map<uint64_t, std::vector<uint64_t>> blocks;
+};
@@ -0,0 +1,266 @@
+#include "headless.hpp"
+
+#include "engine.hpp"
+#include "world.hpp"
+#include "path.hpp"
+#include "replay.hpp"
+#include <SDL2/SDL.h>
+#include <iostream>
+#include <iomanip>
+#include <random>
+
+const int INPUT_KEYS[5] = { SDLK_UP, SDLK_RIGHT, SDLK_DOWN, SDLK_LEFT, SDLK_x };
+const int INPUT_MIN_HOLD_TICKS = 8;
+const int INPUT_MAX_HOLD_TICKS = 64;
+
+const int BENCH_MAP_SIZE = 1024;
+const int BENCH_WALL_PERCENT = 25;
+const int BENCH_ROUTE_LENGTH = 128;
+const int BENCH_POPULAR_DESTINATIONS = 16;
+
+static SDL_Event key_event(Uint32 type, int key) {
+    SDL_Event e;
+    SDL_zero(e);
+    e.type = type;
+    e.key.keysym.sym = key;
+    return e;
+}
+
+static void report_run(int ticks, int threads, Uint64 start_time, Uint64 end_time, uint64_t state_hash) {
+    double seconds = (double)(end_time - start_time) / (double)SDL_GetPerformanceFrequency();
+    double ticks_per_second = seconds > 0.0 ? ticks / seconds : 0.0;
+    double ns_per_tick = ticks > 0 ? (seconds * 1e9) / ticks : 0.0;
+
+    std::cout << "ticks: " << ticks << std::endl;
+    std::cout << "threads: " << threads << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "ticks/sec: " << ticks_per_second << std::endl;
+    std::cout << "ns/tick: " << ns_per_tick << std::endl;
+    std::cout << "state hash: " << std::hex << std::setw(16) << std::setfill('0') << state_hash << std::dec << std::endl;
+}
+
+// Saves a snapshot of the world and restores it into a fresh one, reporting how long each took and whether
+// the restored world's state matches
+static bool check_snapshot(const World* world, const char* path) {
+    Uint64 save_start = SDL_GetPerformanceCounter();
+    if(!world->save_snapshot(path)) {
+        return false;
+    }
+    Uint64 save_end = SDL_GetPerformanceCounter();
+
+    World* restored = new World();
+    Uint64 load_start = SDL_GetPerformanceCounter();
+    bool loaded = restored->load_snapshot(path);
+    Uint64 load_end = SDL_GetPerformanceCounter();
+    bool matched = loaded && restored->state_hash() == world->state_hash();
+    delete restored;
+
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    std::cout << "snapshot save ms: " << (double)(save_end - save_start) * 1000.0 / frequency << std::endl;
+    std::cout << "snapshot load ms: " << (double)(load_end - load_start) * 1000.0 / frequency << std::endl;
+    if(!matched) {
+        std::cout << "Restored snapshot does not match the world!" << std::endl;
+    }
+
+    return matched;
+}
+
+// Runs the world simulation with no window and no frame cap, driven by seeded random input,
+// and reports the simulation throughput along with a hash of the final world state.
+// The session is saved as a replay if a record path was given.
+int headless_run(const HeadlessOptions& options) {
+    Engine engine;
+    if(!engine.init_headless()) {
+        return 1;
+    }
+
+    World* world = new World();
+    world->set_worker_count(options.threads);
+    if(options.npcs != 0) {
+        world->populate(options.npcs, options.seed);
+    }
+
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> key_distribution(0, 4);
+    std::uniform_int_distribution<int> hold_distribution(INPUT_MIN_HOLD_TICKS, INPUT_MAX_HOLD_TICKS);
+    int held_key = -1;
+    int next_input_tick = 0;
+    InputRecording recording;
+    recording.npcs = options.npcs;
+    recording.seed = options.seed;
+    bool recording_input = options.record_path != NULL;
+
+    Uint64 start_time = SDL_GetPerformanceCounter();
+    for(int tick = 0; tick < options.ticks; tick++) {
+        if(tick == next_input_tick) {
+            if(held_key != -1) {
+                SDL_Event key_up = key_event(SDL_KEYUP, held_key);
+                world->handle_input(key_up);
+                if(recording_input) {
+                    recording.record_event(key_up);
+                }
+            }
+
+            held_key = INPUT_KEYS[key_distribution(rng)];
+            SDL_Event key_down = key_event(SDL_KEYDOWN, held_key);
+            world->handle_input(key_down);
+            if(recording_input) {
+                recording.record_event(key_down);
+            }
+            next_input_tick += hold_distribution(rng);
+        }
+
+        world->update();
+        if(recording_input) {
+            recording.record_tick(world->state_hash());
+        }
+    }
+    Uint64 end_time = SDL_GetPerformanceCounter();
+
+    report_run(options.ticks, options.threads, start_time, end_time, world->state_hash());
+
+    bool snapshot_matched = true;
+    if(options.snapshot_path != NULL) {
+        snapshot_matched = check_snapshot(world, options.snapshot_path);
+    }
+
+    delete world;
+    engine.quit();
+
+    if(recording_input && !recording.save(options.record_path)) {
+        return 1;
+    }
+    if(!snapshot_matched) {
+        return 1;
+    }
+
+    return 0;
+}
+
+// Feeds a recorded session to a fresh world at the ticks it was recorded, as fast as possible, and checks
+// the world's state against the recording after every tick. Returns nonzero at the first tick that differs.
+int headless_replay(const HeadlessOptions& options) {
+    InputRecording recording;
+    if(!recording.load(options.replay_path)) {
+        return 1;
+    }
+
+    Engine engine;
+    if(!engine.init_headless()) {
+        return 1;
+    }
+
+    World* world = new World();
+    world->set_worker_count(options.threads);
+    if(recording.npcs != 0) {
+        world->populate(recording.npcs, recording.seed);
+    }
+
+    int tick_count = (int)recording.tick_hashes.size();
+    int event_count = (int)recording.events.size();
+    int next_event = 0;
+    int diverged_tick = -1;
+
+    Uint64 start_time = SDL_GetPerformanceCounter();
+    for(int tick = 0; tick < tick_count; tick++) {
+        while(next_event < event_count && (int)recording.events[next_event].tick <= tick) {
+            world->handle_input(recording.event_at(next_event));
+            next_event++;
+        }
+
+        world->update();
+        if(world->state_hash() != recording.tick_hashes[tick]) {
+            diverged_tick = tick;
+            break;
+        }
+    }
+    Uint64 end_time = SDL_GetPerformanceCounter();
+
+    int ticks_run = diverged_tick == -1 ? tick_count : diverged_tick + 1;
+    report_run(ticks_run, options.threads, start_time, end_time, world->state_hash());
+
+    delete world;
+    engine.quit();
+
+    if(diverged_tick != -1) {
+        std::cout << "Replay diverged at tick " << diverged_tick << "!" << std::endl;
+        return 1;
+    }
+    std::cout << "replay: " << tick_count << " ticks matched" << std::endl;
+
+    return 0;
+}
+
+static vec2 random_open_tile(std::mt19937& rng, const Map& map, vec2 near, int radius) {
+    std::uniform_int_distribution<int> offset_distribution(-radius, radius);
+    while(true) {
+        vec2 tile = near + vec2(offset_distribution(rng), offset_distribution(rng));
+        if(tile.x >= 0 && tile.x < map.width && tile.y >= 0 && tile.y < map.height && !map.get_wall(tile)) {
+            return tile;
+        }
+    }
+}
+
+static void report_queries(const char* name, int queries, int routed, Uint64 start_time, Uint64 end_time) {
+    double seconds = (double)(end_time - start_time) / (double)SDL_GetPerformanceFrequency();
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << name << " queries/sec: " << (seconds > 0.0 ? queries / seconds : 0.0);
+    std::cout << " (" << routed << "/" << queries << " routed)" << std::endl;
+}
+
+// Measures pathfinding throughput on a large map with randomly placed walls, both for one-off routes
+// searched with A* and for repeated queries towards a few popular destinations served by flow fields
+int headless_bench_pathfinding(const HeadlessOptions& options) {
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> percent_distribution(0, 99);
+
+    Map map;
+    map.resize(BENCH_MAP_SIZE, BENCH_MAP_SIZE);
+    for(int y = 0; y < map.height; y++) {
+        for(int x = 0; x < map.width; x++) {
+            map.set_wall(vec2(x, y), percent_distribution(rng) < BENCH_WALL_PERCENT);
+        }
+    }
+
+    Pathfinder pathfinder;
+    pathfinder.init(&map);
+    vec2 center = vec2(BENCH_MAP_SIZE / 2, BENCH_MAP_SIZE / 2);
+    std::vector<vec2> path;
+
+    // One-off routes between random pairs of tiles
+    std::vector<vec2> route_ends;
+    for(int i = 0; i < options.path_queries; i++) {
+        vec2 from = random_open_tile(rng, map, center, (BENCH_MAP_SIZE / 2) - BENCH_ROUTE_LENGTH);
+        route_ends.push_back(from);
+        route_ends.push_back(random_open_tile(rng, map, from, BENCH_ROUTE_LENGTH / 2));
+    }
+    int routed = 0;
+    Uint64 start_time = SDL_GetPerformanceCounter();
+    for(int i = 0; i < options.path_queries; i++) {
+        if(pathfinder.find_path(route_ends[i * 2], route_ends[(i * 2) + 1], path)) {
+            routed++;
+        }
+    }
+    report_queries("A*", options.path_queries, routed, start_time, SDL_GetPerformanceCounter());
+
+    // Next steps from random tiles towards a handful of destinations
+    vec2 destinations[BENCH_POPULAR_DESTINATIONS];
+    for(int i = 0; i < BENCH_POPULAR_DESTINATIONS; i++) {
+        destinations[i] = random_open_tile(rng, map, center, (BENCH_MAP_SIZE / 2) - Pathfinder::FLOW_FIELD_RADIUS);
+    }
+    std::vector<vec2> step_starts;
+    for(int i = 0; i < options.path_queries; i++) {
+        step_starts.push_back(random_open_tile(rng, map, destinations[i % BENCH_POPULAR_DESTINATIONS], Pathfinder::FLOW_FIELD_RADIUS));
+    }
+    routed = 0;
+    start_time = SDL_GetPerformanceCounter();
+    for(int i = 0; i < options.path_queries; i++) {
+        if(pathfinder.next_direction(step_starts[i], destinations[i % BENCH_POPULAR_DESTINATIONS]) != -1) {
+            routed++;
+        }
+    }
+    report_queries("Flow field", options.path_queries, routed, start_time, SDL_GetPerformanceCounter());
+    std::cout << "Flow fields cached: " << pathfinder.flow_field_count() << std::endl;
+
+    return 0;
+}
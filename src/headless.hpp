@@ -0,0 +1,16 @@
+#pragma once
+
+typedef struct HeadlessOptions {
+    int ticks;
+    unsigned int seed;
+    int path_queries;
+    int threads;
+    int npcs;
+    const char* record_path;
+    const char* replay_path;
+    const char* snapshot_path;
+} HeadlessOptions;
+
+int headless_run(const HeadlessOptions& options);
+int headless_replay(const HeadlessOptions& options);
+int headless_bench_pathfinding(const HeadlessOptions& options);
@@ -0,0 +1,95 @@
+#include "jobs.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool() {
+    stopping = false;
+    generation = 0;
+    active_workers = 0;
+    job = NULL;
+    job_count = 0;
+    job_batch_size = 1;
+    next_batch = 0;
+}
+
+WorkerPool::~WorkerPool() {
+    shutdown();
+}
+
+// Thread count includes the calling thread, so 1 runs every job inline
+void WorkerPool::init(int thread_count) {
+    shutdown();
+
+    stopping = false;
+    for(int i = 1; i < thread_count; i++) {
+        threads.push_back(std::thread(&WorkerPool::worker_run, this, i, generation));
+    }
+}
+
+void WorkerPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start_condition.notify_all();
+
+    for(std::thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+}
+
+void WorkerPool::parallel_for(int count, int batch_size, const std::function<void(int begin, int end, int worker)>& job) {
+    if(threads.empty() || count <= batch_size) {
+        job(0, count, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &job;
+        job_count = count;
+        job_batch_size = batch_size;
+        next_batch = 0;
+        active_workers = (int)threads.size();
+        generation++;
+    }
+    start_condition.notify_all();
+
+    run_batches(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_condition.wait(lock, [this] { return active_workers == 0; });
+    this->job = NULL;
+}
+
+void WorkerPool::run_batches(int worker) {
+    while(true) {
+        int begin = next_batch.fetch_add(job_batch_size);
+        if(begin >= job_count) {
+            return;
+        }
+        (*job)(begin, std::min(begin + job_batch_size, job_count), worker);
+    }
+}
+
+void WorkerPool::worker_run(int worker, unsigned long seen_generation) {
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_condition.wait(lock, [this, seen_generation] { return stopping || generation != seen_generation; });
+            if(stopping) {
+                return;
+            }
+            seen_generation = generation;
+        }
+
+        run_batches(worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        active_workers--;
+        if(active_workers == 0) {
+            done_condition.notify_one();
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that split index ranges between themselves and the calling thread.
+// Jobs are handed out in batches, so which thread runs an index is never something results may depend on.
+class WorkerPool {
+    public:
+        WorkerPool();
+        ~WorkerPool();
+
+        void init(int thread_count);
+        int thread_count() const {
+            return (int)threads.size() + 1;
+        }
+
+        void parallel_for(int count, int batch_size, const std::function<void(int begin, int end, int worker)>& job);
+    private:
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable start_condition;
+        std::condition_variable done_condition;
+        bool stopping;
+        unsigned long generation;
+        int active_workers;
+
+        const std::function<void(int, int, int)>* job;
+        int job_count;
+        int job_batch_size;
+        std::atomic<int> next_batch;
+
+        void shutdown();
+        void run_batches(int worker);
+        void worker_run(int worker, unsigned long seen_generation);
+};
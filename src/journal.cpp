@@ -0,0 +1,128 @@
+#include "journal.hpp"
+
+#include <algorithm>
+
+void Journal::clear() {
+    stroke_open = false;
+    pending.clear();
+    undo_strokes.clear();
+    redo_strokes.clear();
+    run_count = 0;
+}
+
+// Journal recording functions
+
+void Journal::stroke_begin() {
+    stroke_end();
+    stroke_open = true;
+}
+
+void Journal::record(JournalLayer layer, int index, int old_value, int new_value) {
+    record_run(layer, index, 1, old_value, new_value);
+}
+
+void Journal::record_run(JournalLayer layer, int start, int length, int old_value, int new_value) {
+    if(!stroke_open || length <= 0 || old_value == new_value) {
+        return;
+    }
+
+    // Most strokes record neighbouring cells one after another, so extend the last run where possible
+    if(!pending.empty()) {
+        JournalRun& last = pending.back();
+        if(last.layer == layer && last.start + last.length == start && last.old_value == old_value && last.new_value == new_value) {
+            last.length += length;
+            return;
+        }
+    }
+
+    pending.push_back((JournalRun) {
+        .start = start,
+        .length = length,
+        .old_value = old_value,
+        .new_value = new_value,
+        .layer = layer
+    });
+}
+
+// Sorts and merges the stroke's runs, then pushes it onto the undo history. Empty strokes are dropped.
+void Journal::stroke_end() {
+    if(!stroke_open) {
+        return;
+    }
+    stroke_open = false;
+    if(pending.empty()) {
+        return;
+    }
+
+    std::sort(pending.begin(), pending.end(), [](const JournalRun& a, const JournalRun& b) {
+        if(a.layer != b.layer) {
+            return a.layer < b.layer;
+        }
+        return a.start < b.start;
+    });
+
+    std::vector<JournalRun> stroke;
+    stroke.reserve(pending.size());
+    for(const JournalRun& run : pending) {
+        if(!stroke.empty()) {
+            JournalRun& last = stroke.back();
+            if(last.layer == run.layer && last.start + last.length == run.start && last.old_value == run.old_value && last.new_value == run.new_value) {
+                last.length += run.length;
+                continue;
+            }
+        }
+        stroke.push_back(run);
+    }
+    pending.clear();
+
+    for(const std::vector<JournalRun>& redo_stroke : redo_strokes) {
+        run_count -= redo_stroke.size();
+    }
+    redo_strokes.clear();
+
+    run_count += stroke.size();
+    undo_strokes.push_back(std::move(stroke));
+    while(run_count > MAX_RUNS && undo_strokes.size() > 1) {
+        run_count -= undo_strokes.front().size();
+        undo_strokes.pop_front();
+    }
+}
+
+// Journal history functions
+
+bool Journal::undo(Map& map) {
+    stroke_end();
+    if(undo_strokes.empty()) {
+        return false;
+    }
+
+    apply(map, undo_strokes.back(), false);
+    redo_strokes.push_back(std::move(undo_strokes.back()));
+    undo_strokes.pop_back();
+
+    return true;
+}
+
+bool Journal::redo(Map& map) {
+    stroke_end();
+    if(redo_strokes.empty()) {
+        return false;
+    }
+
+    apply(map, redo_strokes.back(), true);
+    undo_strokes.push_back(std::move(redo_strokes.back()));
+    redo_strokes.pop_back();
+
+    return true;
+}
+
+void Journal::apply(Map& map, const std::vector<JournalRun>& stroke, bool forwards) {
+    for(const JournalRun& run : stroke) {
+        int value = forwards ? run.new_value : run.old_value;
+        if(run.layer == JOURNAL_WALLS) {
+            map.set_wall_run(run.start, run.length, value != 0);
+        } else {
+            map.set_tile_run((MapLayer)run.layer, run.start, run.length, value);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "map.hpp"
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+// Runs change the tiles of one of the map's layers, or its walls
+typedef enum JournalLayer {
+    JOURNAL_GROUND_TILES = MAP_LAYER_GROUND,
+    JOURNAL_DETAIL_TILES = MAP_LAYER_DETAIL,
+    JOURNAL_OVERLAY_TILES = MAP_LAYER_OVERLAY,
+    JOURNAL_WALLS = MAP_LAYER_COUNT
+} JournalLayer;
+
+// A run of consecutive cells that all changed from old_value to new_value
+typedef struct JournalRun {
+    int start;
+    int length;
+    int old_value;
+    int new_value;
+    JournalLayer layer;
+} JournalRun;
+
+// Undo and redo history for map edits. Each stroke is stored as the run-length encoded cells it changed rather
+// than a copy of the map, and the oldest strokes are forgotten once the history holds more than MAX_RUNS runs.
+// Every cell may only change once per stroke.
+class Journal {
+    public:
+        static constexpr size_t MAX_RUNS = 1 << 20;
+
+        void clear();
+
+        void stroke_begin();
+        void record(JournalLayer layer, int index, int old_value, int new_value);
+        void record_run(JournalLayer layer, int start, int length, int old_value, int new_value);
+        void stroke_end();
+
+        bool undo(Map& map);
+        bool redo(Map& map);
+    private:
+        bool stroke_open = false;
+        std::vector<JournalRun> pending;
+
+        std::deque<std::vector<JournalRun>> undo_strokes;
+        std::vector<std::vector<JournalRun>> redo_strokes;
+        size_t run_count = 0;
+
+        void apply(Map& map, const std::vector<JournalRun>& stroke, bool forwards);
+};
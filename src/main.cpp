@@ -2,12 +2,33 @@
 #include "state.hpp"
 #include "world.hpp"
 #include "edit.hpp"
+#include "headless.hpp"
+#include "profile.hpp"
+#include "replay.hpp"
 #include <string>
+#include <cstring>
 #include <iostream>
 #include <stack>
 
+const char* WORLD_SNAPSHOT_PATH = "./world.snapshot";
+
 int main(int argc, char** argv) {
+    Uint64 startup_counter = SDL_GetPerformanceCounter();
+    bool measure_startup = false;
     bool edit_mode = false;
+    bool headless_mode = false;
+    HeadlessOptions headless_options = (HeadlessOptions) {
+        .ticks = 100000,
+        .seed = 1,
+        .path_queries = 0,
+        .threads = 1,
+        .npcs = 0,
+        .record_path = NULL,
+        .replay_path = NULL,
+        .snapshot_path = NULL
+    };
+    int update_rate = Engine::DEFAULT_UPDATE_RATE;
+    const char* profile_out_path = NULL;
     bool init_fullscreened = false;
     int resolution_width = Engine::SCREEN_WIDTH * 4;
     int resolution_height = Engine::SCREEN_HEIGHT * 4;
@@ -39,11 +60,73 @@ int main(int argc, char** argv) {
                 std::cout << "Incorrect resolution format!" << std::endl;
                 return 0;
             }
+        } else if(arg == "--profile-out") {
+            if(i + 1 == argc) {
+                std::cout << "No profile output file was specified!" << std::endl;
+                return 0;
+            }
+
+            i++;
+            profile_out_path = argv[i];
+        } else if(arg == "--record" || arg == "--replay" || arg == "--snapshot") {
+            if(i + 1 == argc) {
+                std::cout << "No file was specified for " << arg << "!" << std::endl;
+                return 0;
+            }
+
+            i++;
+            if(arg == "--record") {
+                headless_options.record_path = argv[i];
+            } else if(arg == "--replay") {
+                headless_options.replay_path = argv[i];
+            } else {
+                headless_options.snapshot_path = argv[i];
+            }
+        } else if(arg == "--measure-startup") {
+            measure_startup = true;
         } else if(arg == "--edit") {
             edit_mode = true;
+        } else if(arg == "--headless") {
+            headless_mode = true;
+        } else if(arg == "--ticks" || arg == "--seed" || arg == "--bench-pathfinding" || arg == "--threads" || arg == "--npcs" || arg == "--update-rate") {
+            if(i + 1 == argc) {
+                std::cout << "No value was specified for " << arg << "!" << std::endl;
+                return 0;
+            }
+
+            i++;
+            int value = atoi(argv[i]);
+            if(value <= 0) {
+                std::cout << "Incorrect value for " << arg << "!" << std::endl;
+                return 0;
+            }
+
+            if(arg == "--ticks") {
+                headless_options.ticks = value;
+            } else if(arg == "--seed") {
+                headless_options.seed = (unsigned int)value;
+            } else if(arg == "--threads") {
+                headless_options.threads = value;
+            } else if(arg == "--npcs") {
+                headless_options.npcs = value;
+            } else if(arg == "--update-rate") {
+                update_rate = value;
+            } else {
+                headless_options.path_queries = value;
+            }
         }
     }
 
+    if(headless_options.path_queries != 0) {
+        return headless_bench_pathfinding(headless_options);
+    }
+    if(headless_options.replay_path != NULL) {
+        return headless_replay(headless_options);
+    }
+    if(headless_mode) {
+        return headless_run(headless_options);
+    }
+
     Engine engine;
 
     if(!engine.init(resolution_width, resolution_height, init_fullscreened)) {
@@ -51,34 +134,133 @@ int main(int argc, char** argv) {
     }
 
     std::stack<State*> states;
+    World* world = NULL;
 
     if(edit_mode) {
         states.push(new Edit());
     } else {
-        states.push(new World());
+        world = new World();
+        world->set_worker_count(headless_options.threads);
+        states.push(world);
     }
 
     State* current_state = states.top();
 
+    Profiler profiler;
+    if(!profiler.init(profile_out_path)) {
+        return 0;
+    }
+
+    engine.clock_init(update_rate);
+
+    // Sessions are recorded from the world's point of view: the key events it is given and its state after each tick
+    InputRecording recording;
+    bool recording_input = headless_options.record_path != NULL && world != NULL;
+
+    TextBuffer hud_text[2];
+    TextBuffer rendered_hud_text[2];
+    rendered_hud_text[0].clear();
+    rendered_hud_text[1].clear();
+
     bool running = true;
     while(running) {
-        SDL_Event e;
-        while(SDL_PollEvent(&e) != 0) {
-            if(e.type == SDL_QUIT) {
-                running = false;
-            } else{
-                current_state->handle_input(e);
+        // Window events such as exposure can need a redraw even when the game itself hasn't changed
+        bool window_changed = false;
+        {
+            ProfileScope scope(profiler, PROFILE_EVENTS);
+            SDL_Event e;
+            while(SDL_PollEvent(&e) != 0) {
+                if(e.type == SDL_QUIT) {
+                    running = false;
+                } else if(e.type == SDL_WINDOWEVENT) {
+                    window_changed = true;
+                } else if(e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F3) {
+                    profiler.overlay_visible = !profiler.overlay_visible;
+                } else if(e.type == SDL_KEYDOWN && world != NULL && e.key.keysym.sym == SDLK_F5) {
+                    world->save_snapshot(WORLD_SNAPSHOT_PATH);
+                } else if(e.type == SDL_KEYDOWN && world != NULL && e.key.keysym.sym == SDLK_F9) {
+                    // A load replaces the world outside of its input, so a replay of the session couldn't follow it
+                    if(recording_input) {
+                        std::cout << "Cannot load a snapshot while recording!" << std::endl;
+                    } else {
+                        world->load_snapshot(WORLD_SNAPSHOT_PATH);
+                    }
+                } else{
+                    current_state->handle_input(e);
+                    if(recording_input) {
+                        recording.record_event(e);
+                    }
+                }
+            }
+        }
+
+        {
+            ProfileScope scope(profiler, PROFILE_SLEEP);
+            engine.clock_sleep();
+        }
+
+        // The simulation advances in fixed steps, however many frames are drawn in between
+        int due_updates = engine.clock_tick();
+        {
+            ProfileScope scope(profiler, PROFILE_UPDATE);
+            for(int i = 0; i < due_updates; i++) {
+                current_state->update();
+                if(recording_input) {
+                    recording.record_tick(world->state_hash());
+                }
             }
         }
 
-        current_state->update();
+        hud_text[0].clear();
+        hud_text[0].append("FPS ");
+        hud_text[0].append_int(engine.fps);
+        hud_text[0].append(" UPS ");
+        hud_text[0].append_int(engine.ups);
+        hud_text[1].clear();
+        hud_text[1].append("DC ");
+        hud_text[1].append_int(engine.render_draw_calls);
+        hud_text[1].append(" Q ");
+        hud_text[1].append_int(engine.render_quads);
 
-        engine.render_clear();
-        current_state->render(&engine);
-        engine.render_text(("FPS " + std::to_string(engine.fps)).c_str(), 0, 0);
-        engine.render_present();
+        // Only draw frames that would look different from the one on screen, otherwise sleep until the next update or event
+        bool hud_changed = strcmp(hud_text[0].text, rendered_hud_text[0].text) != 0 || strcmp(hud_text[1].text, rendered_hud_text[1].text) != 0;
+        if(window_changed || hud_changed || profiler.overlay_visible || current_state->has_visible_changes(&engine)) {
+            {
+                ProfileScope scope(profiler, PROFILE_RENDER);
+                engine.render_clear();
+                current_state->render(&engine);
+                engine.render_text(hud_text[0].text, 0, 0);
+                engine.render_text(hud_text[1].text, 0, 8);
+                if(profiler.overlay_visible) {
+                    profiler.render_overlay(&engine);
+                }
+                engine.render_flush();
+                rendered_hud_text[0] = hud_text[0];
+                rendered_hud_text[1] = hud_text[1];
+            }
+
+            {
+                ProfileScope scope(profiler, PROFILE_PRESENT);
+                engine.render_present();
+            }
+        } else {
+            ProfileScope scope(profiler, PROFILE_SLEEP);
+            SDL_WaitEventTimeout(NULL, engine.clock_ms_until_update());
+        }
+
+        profiler.frame_end(due_updates);
+
+        // Report how long it took to get the first frame on screen, then quit
+        if(measure_startup) {
+            double startup_ms = (double)(SDL_GetPerformanceCounter() - startup_counter) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+            std::cout << "Startup took " << startup_ms << " ms" << std::endl;
+            running = false;
+        }
+    }
 
-        engine.clock_tick();
+    profiler.quit();
+    if(recording_input) {
+        recording.save(headless_options.record_path);
     }
 
     while(states.size() != 0) {
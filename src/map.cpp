@@ -2,34 +2,70 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char MAP_FILE_MAGIC[4] = { 'F', 'F', 'M', 'P' };
+
+// Allocates the tiles of every layer, with the ground layer zeroed and the layers above it empty
+static MapTile* layers_allocate(int width, int height) {
+    size_t layer_cells = (size_t)width * (size_t)height;
+    MapTile* tiles = new MapTile[layer_cells * MAP_LAYER_COUNT]();
+    std::fill(tiles + layer_cells, tiles + (layer_cells * MAP_LAYER_COUNT), MAP_TILE_EMPTY);
+
+    return tiles;
+}
 
 Map::Map() {
     width = 10;
     height = 9;
 
-    tiles = new int[width * height];
-    walls = new bool[width * height];
-    for(int i = 0; i < width * height; i++) {
-        tiles[i] = 0;
-        walls[i] = false;
-    }
+    wall_row_words = wall_words_for(width);
+    tiles = layers_allocate(width, height);
+    walls = new uint64_t[height * wall_row_words]();
 
     camera_position = vec2(0, 0);
+    std::fill(layer_visible, layer_visible + MAP_LAYER_COUNT, true);
+    pager = NULL;
+    render_frame = 0;
+    wall_revision = 0;
+    animation_tick = 0;
+
+    chunks_init();
 }
 
 Map::~Map() {
+    chunks_free();
+    delete pager;
+
     delete [] tiles;
     delete [] walls;
 }
 
+void Map::update() {
+    animation_tick++;
+
+    if(pager != NULL) {
+        pager->update(tile_at(camera_position + vec2(Engine::SCREEN_WIDTH / 2, Engine::SCREEN_HEIGHT / 2)));
+    }
+}
+
 void Map::render(Engine* engine) {
     render_with_walls(engine, false);
 }
 
 void Map::render_with_walls(Engine* engine, bool with_walls) {
-    SDL_SetRenderDrawColor(engine->renderer, 255, 0, 0, 255);
+    render_layers(engine, MAP_LAYER_GROUND, MAP_LAYER_OVERLAY);
 
-    // Render map
+    if(!with_walls) {
+        return;
+    }
+
+    // Render walls on top of the queued tiles
     vec2 start_tile = tile_at(camera_position);
     vec2 base_render_pos = position_of(start_tile) - camera_position;
     vec2 draw_size = vec2(Engine::SCREEN_WIDTH / Engine::TILE_SIZE, Engine::SCREEN_HEIGHT / Engine::TILE_SIZE);
@@ -39,21 +75,118 @@ void Map::render_with_walls(Engine* engine, bool with_walls) {
     if(camera_position.y % Engine::TILE_SIZE != 0) {
         draw_size.y++;
     }
+    engine->render_flush();
+    SDL_SetRenderDrawColor(engine->renderer, 255, 0, 0, 255);
     for(int y = 0; y < draw_size.y; y++) {
+        int tile_y = start_tile.y + y;
+        if(tile_y < 0 || tile_y >= height || !row_has_wall(tile_y, std::max(start_tile.x, 0), std::min(start_tile.x + draw_size.x, width) - 1)) {
+            continue;
+        }
         for(int x = 0; x < draw_size.x; x++) {
             vec2 tile = start_tile + vec2(x, y);
-            if(tile.x < 0 || tile.x >= width || tile.y < 0 || tile.y >= height) {
+            if(tile.x < 0 || tile.x >= width || !get_wall(tile)) {
                 continue;
             }
             vec2 render_pos = base_render_pos + vec2(x * Engine::TILE_SIZE, y * Engine::TILE_SIZE);
-            engine->render_sprite_frame(SPRITE_TILES, get_tile(tile), render_pos.x, render_pos.y, false);
+            SDL_RenderDrawLine(engine->renderer, render_pos.x, render_pos.y, render_pos.x + Engine::TILE_SIZE, render_pos.y + Engine::TILE_SIZE);
+            SDL_RenderDrawLine(engine->renderer, render_pos.x, render_pos.y + Engine::TILE_SIZE, render_pos.x + Engine::TILE_SIZE, render_pos.y);
+        }
+    }
+}
+
+void Map::render_layers(Engine* engine, MapLayer first_layer, MapLayer last_layer) {
+    // Render the cached chunks that overlap the screen, one layer at a time
+    const int chunk_pixel_size = CHUNK_SIZE * Engine::TILE_SIZE;
+    vec2 first_chunk = vec2((int)floor((float)camera_position.x / chunk_pixel_size), (int)floor((float)camera_position.y / chunk_pixel_size));
+    vec2 last_chunk = vec2((int)floor((float)(camera_position.x + Engine::SCREEN_WIDTH - 1) / chunk_pixel_size),
+                           (int)floor((float)(camera_position.y + Engine::SCREEN_HEIGHT - 1) / chunk_pixel_size));
+    if(first_layer == MAP_LAYER_GROUND) {
+        visible_animations.clear();
+    }
+    for(int layer = first_layer; layer <= last_layer; layer++) {
+        if(!layer_visible[layer]) {
+            continue;
+        }
+
+        std::unordered_map<int, MapChunk>& layer_chunks = chunks[layer];
+        animated_chunks.clear();
+        for(int chunk_y = std::max(first_chunk.y, 0); chunk_y <= std::min(last_chunk.y, chunk_rows - 1); chunk_y++) {
+            for(int chunk_x = std::max(first_chunk.x, 0); chunk_x <= std::min(last_chunk.x, chunk_columns - 1); chunk_x++) {
+                auto cached_chunk = layer_chunks.find((chunk_y * chunk_columns) + chunk_x);
+                if(cached_chunk == layer_chunks.end()) {
+                    cached_chunk = layer_chunks.emplace((chunk_y * chunk_columns) + chunk_x, (MapChunk) {
+                        .texture = NULL,
+                        .empty = false,
+                        .dirty = true,
+                        .last_used_frame = render_frame
+                    }).first;
+                }
+                MapChunk& chunk = cached_chunk->second;
+                chunk.last_used_frame = render_frame;
+                if(chunk.dirty || (chunk.texture == NULL && !chunk.empty)) {
+                    chunk_render(engine, (MapLayer)layer, chunk_x, chunk_y);
+                }
+                if(!chunk.animated_cells.empty()) {
+                    animated_chunks.push_back(&chunk);
+                }
+                if(chunk.texture == NULL || chunk.empty) {
+                    continue;
+                }
+
+                vec2 chunk_tile_size = vec2(std::min(CHUNK_SIZE, width - (chunk_x * CHUNK_SIZE)), std::min(CHUNK_SIZE, height - (chunk_y * CHUNK_SIZE)));
+                vec2 render_pos = vec2(chunk_x * chunk_pixel_size, chunk_y * chunk_pixel_size) - camera_position;
+                engine->render_texture(chunk.texture, render_pos.x, render_pos.y, chunk_tile_size.x * Engine::TILE_SIZE, chunk_tile_size.y * Engine::TILE_SIZE);
+            }
+        }
+
+        // Then draw the layer's animated cells over the holes left for them, all from the tile sheet in one batch
+        for(const MapChunk* chunk : animated_chunks) {
+            for(const MapAnimatedCell& cell : chunk->animated_cells) {
+                vec2 render_pos = position_of(cell.tile) - camera_position;
+                engine->render_sprite_frame(SPRITE_TILES, tile_animations.frame_at(cell.animation, animation_tick), render_pos.x, render_pos.y, false);
+                if(animation_drawn_frame[cell.animation] != render_frame) {
+                    animation_drawn_frame[cell.animation] = render_frame;
+                    visible_animations.push_back(cell.animation);
+                }
+            }
+        }
 
-            if(with_walls && get_wall(tile)) {
-                SDL_RenderDrawLine(engine->renderer, render_pos.x, render_pos.y, render_pos.x + Engine::TILE_SIZE, render_pos.y + Engine::TILE_SIZE);
-                SDL_RenderDrawLine(engine->renderer, render_pos.x, render_pos.y + Engine::TILE_SIZE, render_pos.x + Engine::TILE_SIZE, render_pos.y);
+        // Once a layer's cache is over budget, drop every chunk of it that wasn't on screen this frame
+        if((int)layer_chunks.size() > MAX_CACHED_CHUNKS) {
+            for(auto it = layer_chunks.begin(); it != layer_chunks.end();) {
+                if(it->second.last_used_frame != render_frame) {
+                    if(it->second.texture != NULL) {
+                        SDL_DestroyTexture(it->second.texture);
+                    }
+                    it = layer_chunks.erase(it);
+                } else {
+                    it++;
+                }
             }
         }
     }
+    render_frame++;
+}
+
+// Replaces the tile animations, which changes which cells the chunk cache can hold
+bool Map::load_tile_animations(const char* path) {
+    bool loaded = tile_animations.load(path);
+    animation_drawn_frame.assign(tile_animations.count(), -1);
+    visible_animations.clear();
+    chunks_init();
+
+    return loaded;
+}
+
+// Totals how far the animations drawn by the last render have advanced. Steps only ever grow, so the total
+// changes exactly when one of the animations on screen shows a new frame.
+uint32_t Map::visible_animation_steps() const {
+    uint32_t steps = 0;
+    for(int animation : visible_animations) {
+        steps += tile_animations.step_at(animation, animation_tick);
+    }
+
+    return steps;
 }
 
 bool Map::in_bounds(vec2 pos) const {
@@ -61,37 +194,207 @@ bool Map::in_bounds(vec2 pos) const {
     return index >= 0 && index < width * height;
 }
 
-int Map::get_tile(vec2 pos) const {
-    return tiles[to_index(pos)];
+int Map::get_tile(MapLayer layer, vec2 pos) const {
+    if(pager != NULL) {
+        return pager->get_tile(layer, to_index(pos));
+    }
+    return layer_tiles(layer)[to_index(pos)];
 }
 
 bool Map::get_wall(vec2 pos) const {
-    return walls[to_index(pos)];
+    if(pager != NULL) {
+        return pager->get_wall(to_index(pos));
+    }
+    uint64_t mask;
+    return (*wall_word(pos, mask) & mask) != 0;
 }
 
-void Map::set_tile(vec2 pos, int value) {
-    tiles[to_index(pos)] = value;
+void Map::set_tile(MapLayer layer, vec2 pos, int value) {
+    if(get_tile(layer, pos) == value) {
+        return;
+    }
+    if(pager != NULL) {
+        if(!pager->has_layer(layer)) {
+            std::cout << "Streamed map file has no such layer!" << std::endl;
+            return;
+        }
+        pager->set_tile(layer, to_index(pos), value);
+    } else {
+        layer_tiles(layer)[to_index(pos)] = (MapTile)value;
+    }
+    chunk_mark_dirty(layer, pos);
 }
 
 void Map::set_wall(vec2 pos, bool value) {
-    walls[to_index(pos)] = value;
+    if(get_wall(pos) == value) {
+        return;
+    }
+    wall_revision++;
+
+    if(pager != NULL) {
+        pager->set_wall(to_index(pos), value);
+        return;
+    }
+    uint64_t mask;
+    uint64_t* word = wall_word(pos, mask);
+    *word = value ? (*word | mask) : (*word & ~mask);
 }
 
-void Map::resize(int new_width, int new_height) {
-    int* new_tiles = new int[new_width * new_height];
-    bool* new_walls = new bool[new_width * new_height];
+void Map::set_tile_run(MapLayer layer, int index, int length, int value) {
+    if(pager != NULL) {
+        if(!pager->has_layer(layer)) {
+            std::cout << "Streamed map file has no such layer!" << std::endl;
+            return;
+        }
+        for(int i = index; i < index + length; i++) {
+            pager->set_tile(layer, i, value);
+        }
+    } else {
+        std::fill(layer_tiles(layer) + index, layer_tiles(layer) + index + length, (MapTile)value);
+    }
+    chunks_mark_run_dirty(layer, index, length);
+}
+
+void Map::set_wall_run(int index, int length, bool value) {
+    wall_revision++;
+
+    if(pager != NULL) {
+        for(int i = index; i < index + length; i++) {
+            pager->set_wall(i, value);
+        }
+        return;
+    }
+
+    int end = index + length;
+    while(index < end) {
+        int y = index / width;
+        int first_x = index % width;
+        int last_x = std::min(width, first_x + (end - index)) - 1;
+        wall_fill_row(y, first_x, last_x, value);
+        index += (last_x - first_x) + 1;
+    }
+}
+
+void Map::clear_region(vec2 from, vec2 size) {
+    if(size.x <= 0 || size.y <= 0) {
+        return;
+    }
+    if(pager != NULL) {
+        for(int y = from.y; y < from.y + size.y; y++) {
+            for(int layer = 0; layer < MAP_LAYER_COUNT && pager->has_layer((MapLayer)layer); layer++) {
+                set_tile_run((MapLayer)layer, to_index(vec2(from.x, y)), size.x, layer == MAP_LAYER_GROUND ? 0 : MAP_TILE_EMPTY);
+            }
+            set_wall_run(to_index(vec2(from.x, y)), size.x, false);
+        }
+        return;
+    }
+
+    for(int y = from.y; y < from.y + size.y; y++) {
+        for(int layer = 0; layer < MAP_LAYER_COUNT; layer++) {
+            MapTile* row = layer_tiles(layer) + to_index(vec2(from.x, y));
+            std::fill(row, row + size.x, layer == MAP_LAYER_GROUND ? 0 : MAP_TILE_EMPTY);
+            chunks_mark_run_dirty((MapLayer)layer, to_index(vec2(from.x, y)), size.x);
+        }
+        wall_fill_row(y, from.x, from.x + size.x - 1, false);
+    }
+    wall_revision++;
+}
+
+// Checks whether any cell from first_x to last_x of a row is a wall, testing a whole word of cells at a time
+bool Map::row_has_wall(int y, int first_x, int last_x) const {
+    if(first_x > last_x) {
+        return false;
+    }
+    if(pager != NULL) {
+        for(int x = first_x; x <= last_x; x++) {
+            if(get_wall(vec2(x, y))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const uint64_t* row = walls + (y * wall_row_words);
+    int first_word = first_x / WALL_WORD_BITS;
+    int last_word = last_x / WALL_WORD_BITS;
+    for(int word = first_word; word <= last_word; word++) {
+        uint64_t mask = ~(uint64_t)0;
+        if(word == first_word) {
+            mask &= ~(uint64_t)0 << (first_x % WALL_WORD_BITS);
+        }
+        if(word == last_word) {
+            mask &= ~(uint64_t)0 >> (WALL_WORD_BITS - 1 - (last_x % WALL_WORD_BITS));
+        }
+        if((row[word] & mask) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t Map::wall_bits(int y, int first_x, int count) const {
+    uint64_t bits = 0;
+    if(count <= 0) {
+        return bits;
+    }
+    if(pager != NULL) {
+        for(int x = 0; x < count; x++) {
+            bits |= (uint64_t)get_wall(vec2(first_x + x, y)) << x;
+        }
+        return bits;
+    }
 
-    for(int i = 0; i < new_width * new_height; i++) {
-        new_tiles[i] = 0;
-        new_walls[i] = false;
+    // Shift the cells down from the word first_x is in, and up from the next one if they run into it
+    const uint64_t* row = walls + (y * wall_row_words);
+    int word = first_x / WALL_WORD_BITS;
+    int shift = first_x % WALL_WORD_BITS;
+    bits = row[word] >> shift;
+    if(shift != 0 && word + 1 < wall_row_words) {
+        bits |= row[word + 1] << (WALL_WORD_BITS - shift);
+    }
+    if(count < WALL_WORD_BITS) {
+        bits &= ((uint64_t)1 << count) - 1;
     }
-    for(int y = 0; y < (int)fmin(height, new_height); y++) {
-        for(int x = 0; x < (int)fmin(width, new_width); x++) {
-            int old_index = (y * width) + x;
-            int new_index = (y * new_width) + x;
+    return bits;
+}
 
-            new_tiles[new_index] = tiles[old_index];
-            new_walls[new_index] = walls[old_index];
+void Map::wall_fill_row(int y, int first_x, int last_x, bool value) {
+    uint64_t* row = walls + (y * wall_row_words);
+    int first_word = first_x / WALL_WORD_BITS;
+    int last_word = last_x / WALL_WORD_BITS;
+    for(int word = first_word; word <= last_word; word++) {
+        uint64_t mask = ~(uint64_t)0;
+        if(word == first_word) {
+            mask &= ~(uint64_t)0 << (first_x % WALL_WORD_BITS);
+        }
+        if(word == last_word) {
+            mask &= ~(uint64_t)0 >> (WALL_WORD_BITS - 1 - (last_x % WALL_WORD_BITS));
+        }
+        row[word] = value ? (row[word] | mask) : (row[word] & ~mask);
+    }
+}
+
+void Map::resize(int new_width, int new_height) {
+    if(pager != NULL) {
+        std::cout << "Cannot resize a streamed map!" << std::endl;
+        return;
+    }
+
+    int new_wall_row_words = wall_words_for(new_width);
+    MapTile* new_tiles = layers_allocate(new_width, new_height);
+    uint64_t* new_walls = new uint64_t[new_height * new_wall_row_words]();
+
+    // Copy whole rows, masking off the walls past the new width in the last word kept
+    int kept_width = std::min(width, new_width);
+    int kept_words = wall_words_for(kept_width);
+    uint64_t last_word_mask = ~(uint64_t)0 >> ((kept_words * WALL_WORD_BITS) - kept_width);
+    for(int y = 0; y < std::min(height, new_height); y++) {
+        for(int layer = 0; layer < MAP_LAYER_COUNT; layer++) {
+            memcpy(new_tiles + ((size_t)layer * new_width * new_height) + (y * new_width), layer_tiles(layer) + (y * width), sizeof(MapTile) * kept_width);
+        }
+        if(kept_words > 0) {
+            memcpy(new_walls + (y * new_wall_row_words), walls + (y * wall_row_words), sizeof(uint64_t) * kept_words);
+            new_walls[(y * new_wall_row_words) + kept_words - 1] &= last_word_mask;
         }
     }
 
@@ -100,8 +403,12 @@ void Map::resize(int new_width, int new_height) {
 
     tiles = new_tiles;
     walls = new_walls;
+    wall_row_words = new_wall_row_words;
     width = new_width;
     height = new_height;
+    wall_revision++;
+
+    chunks_init();
 }
 
 void Map::save_to_file(const char* path) {
@@ -112,10 +419,11 @@ void Map::save_to_file(const char* path) {
         return;
     }
 
+    // The layers above the ground come after the walls, so files from before maps had layers still load
     outfile << width << "," << height << std::endl;
     for(int y = 0; y < height; y++) {
         for(int x = 0; x < width; x++) {
-            outfile << get_tile(vec2(x, y));
+            outfile << get_tile(MAP_LAYER_GROUND, vec2(x, y));
             if(x != width - 1) {
                 outfile << ",";
             }
@@ -131,59 +439,371 @@ void Map::save_to_file(const char* path) {
         }
         outfile << "\n";
     }
+    for(int layer = MAP_LAYER_GROUND + 1; layer < MAP_LAYER_COUNT; layer++) {
+        for(int y = 0; y < height; y++) {
+            for(int x = 0; x < width; x++) {
+                outfile << get_tile((MapLayer)layer, vec2(x, y));
+                if(x != width - 1) {
+                    outfile << ",";
+                }
+            }
+            outfile << "\n";
+        }
+    }
 
     outfile.close();
 }
 
 void Map::load_from_file(const char* path) {
-    std::ifstream infile(path);
+    std::ifstream infile(path, std::ios::in | std::ios::binary);
 
     if(!infile.is_open()) {
         std::cout << "Unable to open file!" << std::endl;
         return;
     }
 
-    std::string line;
-    getline(infile, line);
+    // Binary maps are recognized by their magic rather than their extension
+    char magic[4] = { 0, 0, 0, 0 };
+    infile.read(magic, 4);
+    if(infile.gcount() == 4 && memcmp(magic, MAP_FILE_MAGIC, 4) == 0) {
+        infile.close();
+        load_from_binary_file(path);
+        return;
+    }
 
-    width = atoi(line.substr(0, line.find(',')).c_str());
-    height = atoi(line.substr(line.find(',') + 1).c_str());
+    // Read the whole file at once and walk it with a cursor so parsing stays linear in the file size
+    // A file shorter than the magic leaves the stream failed, which would make seeking and tellg fail too
+    infile.clear();
+    infile.seekg(0, std::ios::end);
+    std::streamoff length = infile.tellg();
+    if(length < 0) {
+        std::cout << "Invalid map file!" << std::endl;
+        return;
+    }
+    std::string contents((size_t)length, '\0');
+    infile.seekg(0, std::ios::beg);
+    infile.read(&contents[0], contents.length());
+    infile.close();
 
-    delete [] tiles;
-    delete [] walls;
+    const char* cursor = contents.c_str();
+    char* next;
 
-    tiles = new int[width * height];
-    walls = new bool[width * height];
+    int new_width = (int)strtol(cursor, &next, 10);
+    cursor = (*next == ',') ? next + 1 : next;
+    int new_height = (int)strtol(cursor, &next, 10);
+    cursor = next;
+    if(new_width <= 0 || new_height <= 0) {
+        std::cout << "Invalid map dimensions!" << std::endl;
+        return;
+    }
+
+    allocate(new_width, new_height);
 
+    for(int i = 0; i < width * height; i++) {
+        tiles[i] = (MapTile)strtol(cursor, &next, 10);
+        cursor = (*next == ',') ? next + 1 : next;
+    }
     for(int y = 0; y < height; y++) {
-        getline(infile, line);
         for(int x = 0; x < width; x++) {
-            size_t comma_index = line.find(',');
-            int tile;
-            if(comma_index == std::string::npos) {
-                tile = atoi(line.c_str());
-            } else {
-                tile = atoi(line.substr(0, comma_index).c_str());
-                line = line.substr(comma_index + 1);
+            if(strtol(cursor, &next, 10) != 0) {
+                walls[(y * wall_row_words) + (x / WALL_WORD_BITS)] |= (uint64_t)1 << (x % WALL_WORD_BITS);
             }
-            set_tile(vec2(x, y), tile);
+            cursor = (*next == ',') ? next + 1 : next;
+        }
+    }
+    // Older files end after the walls, leaving the upper layers empty
+    MapTile* upper_tiles = layer_tiles(MAP_LAYER_GROUND + 1);
+    for(int i = 0; i < width * height * (MAP_LAYER_COUNT - 1); i++) {
+        long value = strtol(cursor, &next, 10);
+        if(next == cursor) {
+            break;
         }
+        upper_tiles[i] = (MapTile)value;
+        cursor = (*next == ',') ? next + 1 : next;
     }
+}
 
-    for(int y = 0; y < height; y++) {
-        getline(infile, line);
-        for(int x = 0; x < width; x++) {
-            size_t comma_index = line.find(',');
-            bool wall;
-            if(comma_index == std::string::npos) {
-                wall = (bool)atoi(line.c_str());
+void Map::save_to_binary_file(const char* path) {
+    if(pager != NULL) {
+        std::cout << "Streamed maps are saved in place!" << std::endl;
+        pager->flush();
+        return;
+    }
+
+    std::ofstream outfile(path, std::ios::out | std::ios::binary);
+
+    if(!outfile.is_open()) {
+        std::cout << "Unable to open file!" << std::endl;
+        return;
+    }
+
+    MapFileHeader header;
+    memcpy(header.magic, MAP_FILE_MAGIC, 4);
+    header.version = FILE_VERSION;
+    header.width = width;
+    header.height = height;
+
+    outfile.write((const char*)&header, sizeof(MapFileHeader));
+    outfile.write((const char*)tiles, sizeof(uint16_t) * width * height * MAP_LAYER_COUNT);
+    outfile.write((const char*)walls, sizeof(uint64_t) * height * wall_row_words);
+
+    outfile.close();
+}
+
+bool Map::load_from_binary_file(const char* path) {
+    static_assert(sizeof(MapTile) == sizeof(uint16_t), "Binary maps are copied straight into the tile and wall arrays");
+
+    int fd = open(path, O_RDONLY);
+    if(fd == -1) {
+        std::cout << "Unable to open file!" << std::endl;
+        return false;
+    }
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) == -1 || (size_t)file_stat.st_size < sizeof(MapFileHeader)) {
+        std::cout << "Invalid map file!" << std::endl;
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        std::cout << "Unable to map file!" << std::endl;
+        return false;
+    }
+
+    const MapFileHeader* header = (const MapFileHeader*)data;
+    size_t cell_count = (size_t)header->width * (size_t)header->height;
+    size_t file_layers = header->version == FILE_VERSION ? MAP_LAYER_COUNT : 1;
+    size_t data_size = 0;
+    if(header->version == FILE_VERSION || header->version == SINGLE_LAYER_FILE_VERSION) {
+        data_size = (cell_count * file_layers * sizeof(uint16_t)) + ((size_t)header->height * wall_words_for(header->width) * sizeof(uint64_t));
+    } else if(header->version == BYTE_WALLS_FILE_VERSION) {
+        data_size = cell_count * (sizeof(int32_t) + sizeof(uint8_t));
+    }
+    bool valid = memcmp(header->magic, MAP_FILE_MAGIC, 4) == 0 &&
+                 data_size != 0 &&
+                 header->width > 0 && header->height > 0 &&
+                 (size_t)file_stat.st_size >= sizeof(MapFileHeader) + data_size;
+    if(!valid) {
+        std::cout << "Invalid map file!" << std::endl;
+        munmap(data, file_stat.st_size);
+        return false;
+    }
+
+    allocate(header->width, header->height);
+    const char* tile_data = (const char*)data + sizeof(MapFileHeader);
+    if(header->version != BYTE_WALLS_FILE_VERSION) {
+        // The arrays are laid out exactly as in memory, so each one loads with a single copy
+        memcpy(tiles, tile_data, cell_count * file_layers * sizeof(uint16_t));
+        memcpy(walls, tile_data + (cell_count * file_layers * sizeof(uint16_t)), (size_t)height * wall_row_words * sizeof(uint64_t));
+    } else {
+        const int32_t* old_tiles = (const int32_t*)tile_data;
+        const uint8_t* old_walls = (const uint8_t*)(tile_data + (cell_count * sizeof(int32_t)));
+        for(size_t i = 0; i < cell_count; i++) {
+            tiles[i] = (MapTile)old_tiles[i];
+        }
+        for(int y = 0; y < height; y++) {
+            for(int x = 0; x < width; x++) {
+                if(old_walls[((size_t)y * width) + x] != 0) {
+                    walls[(y * wall_row_words) + (x / WALL_WORD_BITS)] |= (uint64_t)1 << (x % WALL_WORD_BITS);
+                }
+            }
+        }
+    }
+
+    munmap(data, file_stat.st_size);
+
+    return true;
+}
+
+// Streams the map from a binary map file instead of loading it, keeping at most memory_budget bytes of it resident
+bool Map::open_paged(const char* path, size_t memory_budget) {
+    MapPager* new_pager = new MapPager();
+    if(!new_pager->open(path, memory_budget)) {
+        delete new_pager;
+        return false;
+    }
+
+    delete pager;
+    delete [] tiles;
+    delete [] walls;
+
+    pager = new_pager;
+    tiles = NULL;
+    walls = NULL;
+    width = pager->width;
+    height = pager->height;
+    wall_row_words = wall_words_for(width);
+    wall_revision++;
+
+    chunks_init();
+    update();
+
+    return true;
+}
+
+// Snapshots hold the map's cells unless it is streamed, in which case the streamed file is the map
+void Map::snapshot_write(SnapshotWriter& writer) const {
+    writer.write_value(width);
+    writer.write_value(height);
+    writer.write_value(camera_position);
+    writer.write_value(is_paged());
+    if(pager == NULL) {
+        writer.write_array(tiles, width * height * MAP_LAYER_COUNT);
+        writer.write_array(walls, height * wall_row_words);
+    }
+}
+
+// Streamed maps only save the camera, so their snapshots can only be restored onto the same streamed map
+void Map::snapshot_read(SnapshotReader& reader, MapSnapshot& snapshot) const {
+    snapshot.width = 0;
+    snapshot.height = 0;
+    snapshot.paged = false;
+    reader.read_value(snapshot.width);
+    reader.read_value(snapshot.height);
+    reader.read_value(snapshot.camera_position);
+    reader.read_value(snapshot.paged);
+    if(reader.failed()) {
+        return;
+    }
+
+    if(snapshot.paged) {
+        if(pager == NULL || snapshot.width != width || snapshot.height != height) {
+            std::cout << "Snapshot was taken on a different streamed map!" << std::endl;
+            reader.fail();
+        }
+        return;
+    }
+
+    if(snapshot.width <= 0 || snapshot.height <= 0 ||
+       (size_t)snapshot.width * (size_t)snapshot.height * MAP_LAYER_COUNT * sizeof(MapTile) > reader.remaining()) {
+        reader.fail();
+        return;
+    }
+    snapshot.tiles.resize((size_t)snapshot.width * snapshot.height * MAP_LAYER_COUNT);
+    snapshot.walls.resize((size_t)snapshot.height * wall_words_for(snapshot.width));
+    reader.read_array(snapshot.tiles.data(), snapshot.tiles.size());
+    reader.read_array(snapshot.walls.data(), snapshot.walls.size());
+}
+
+void Map::snapshot_restore(const MapSnapshot& snapshot) {
+    camera_position = snapshot.camera_position;
+    if(snapshot.paged) {
+        return;
+    }
+
+    allocate(snapshot.width, snapshot.height);
+    std::copy(snapshot.tiles.begin(), snapshot.tiles.end(), tiles);
+    std::copy(snapshot.walls.begin(), snapshot.walls.end(), walls);
+}
+
+void Map::allocate(int new_width, int new_height) {
+    delete pager;
+    pager = NULL;
+    delete [] tiles;
+    delete [] walls;
+
+    width = new_width;
+    height = new_height;
+    wall_row_words = wall_words_for(width);
+    tiles = layers_allocate(width, height);
+    walls = new uint64_t[height * wall_row_words]();
+    wall_revision++;
+
+    chunks_init();
+}
+
+// Chunk cache functions
+
+void Map::chunks_init() {
+    chunks_free();
+
+    chunk_columns = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    chunk_rows = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+}
+
+void Map::chunks_free() {
+    for(int layer = 0; layer < MAP_LAYER_COUNT; layer++) {
+        for(auto& entry : chunks[layer]) {
+            if(entry.second.texture != NULL) {
+                SDL_DestroyTexture(entry.second.texture);
+            }
+        }
+        chunks[layer].clear();
+    }
+}
+
+void Map::chunk_mark_dirty(MapLayer layer, vec2 pos) {
+    auto cached_chunk = chunks[layer].find(((pos.y / CHUNK_SIZE) * chunk_columns) + (pos.x / CHUNK_SIZE));
+    if(cached_chunk != chunks[layer].end()) {
+        cached_chunk->second.dirty = true;
+    }
+}
+
+// Marks every chunk of a layer a run of cells passes through, one row at a time
+void Map::chunks_mark_run_dirty(MapLayer layer, int index, int length) {
+    int end = index + length;
+    while(index < end) {
+        int y = index / width;
+        int first_x = index % width;
+        int last_x = std::min(width, first_x + (end - index)) - 1;
+        for(int chunk_x = first_x / CHUNK_SIZE; chunk_x <= last_x / CHUNK_SIZE; chunk_x++) {
+            chunk_mark_dirty(layer, vec2(chunk_x * CHUNK_SIZE, y));
+        }
+        index += (last_x - first_x) + 1;
+    }
+}
+
+void Map::chunk_render(Engine* engine, MapLayer layer, int chunk_x, int chunk_y) {
+    MapChunk& chunk = chunks[layer].at((chunk_y * chunk_columns) + chunk_x);
+    vec2 base_tile = vec2(chunk_x * CHUNK_SIZE, chunk_y * CHUNK_SIZE);
+    chunk.dirty = false;
+
+    // Upper layers are mostly empty, and their empty chunks give back their textures rather than drawing nothing
+    chunk.empty = true;
+    chunk.animated_cells.clear();
+    for(int y = 0; y < CHUNK_SIZE && base_tile.y + y < height; y++) {
+        for(int x = 0; x < CHUNK_SIZE && base_tile.x + x < width; x++) {
+            int tile = get_tile(layer, base_tile + vec2(x, y));
+            if(tile == MAP_TILE_EMPTY) {
+                continue;
+            }
+            int animation = tile_animations.find(tile);
+            if(animation != TILE_ANIMATION_NONE) {
+                chunk.animated_cells.push_back((MapAnimatedCell) {
+                    .tile = base_tile + vec2(x, y),
+                    .animation = animation
+                });
             } else {
-                wall = (bool)atoi(line.substr(0, comma_index).c_str());
-                line = line.substr(comma_index + 1);
+                chunk.empty = false;
             }
-            set_wall(vec2(x, y), wall);
         }
     }
+    if(chunk.empty) {
+        if(chunk.texture != NULL) {
+            SDL_DestroyTexture(chunk.texture);
+            chunk.texture = NULL;
+        }
+        return;
+    }
 
-    infile.close();
+    if(chunk.texture == NULL) {
+        chunk.texture = engine->render_target_create(CHUNK_SIZE * Engine::TILE_SIZE, CHUNK_SIZE * Engine::TILE_SIZE);
+        if(chunk.texture == NULL) {
+            return;
+        }
+    }
+
+    engine->render_target_begin(chunk.texture);
+    for(int y = 0; y < CHUNK_SIZE && base_tile.y + y < height; y++) {
+        for(int x = 0; x < CHUNK_SIZE && base_tile.x + x < width; x++) {
+            int tile = get_tile(layer, base_tile + vec2(x, y));
+            if(tile != MAP_TILE_EMPTY && tile_animations.find(tile) == TILE_ANIMATION_NONE) {
+                engine->render_sprite_frame(SPRITE_TILES, tile, x * Engine::TILE_SIZE, y * Engine::TILE_SIZE, false);
+            }
+        }
+    }
+    engine->render_target_end();
 }
@@ -2,41 +2,165 @@
 
 #include "engine.hpp"
 #include "vector.hpp"
+#include "pager.hpp"
+#include "snapshot.hpp"
+#include "tiles.hpp"
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Binary map files are this header followed by the tiles, then the walls. Version 3 files hold MAP_LAYER_COUNT
+// layers of width * height uint16 tiles, then each row of walls as a bitset padded to whole uint64 words.
+// Version 2 files are laid out the same with only the ground layer. Version 1 files hold width * height
+// int32 tiles, then width * height uint8 walls, and are converted when read.
+typedef struct MapFileHeader {
+    char magic[4];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+} MapFileHeader;
+
+extern const char MAP_FILE_MAGIC[4];
+
+typedef struct MapAnimatedCell {
+    vec2 tile;
+    int animation;
+} MapAnimatedCell;
+
+// Animated cells are left out of the chunk's texture and drawn over it every frame
+typedef struct MapChunk {
+    SDL_Texture* texture;
+    // Set when the chunk has no static tiles, so its texture would be blank and isn't kept
+    bool empty;
+    bool dirty;
+    int last_used_frame;
+    std::vector<MapAnimatedCell> animated_cells;
+} MapChunk;
+
+// A map's state read from a snapshot, kept apart from the map until the rest of the snapshot has been checked
+typedef struct MapSnapshot {
+    int width;
+    int height;
+    vec2 camera_position;
+    bool paged;
+    std::vector<MapTile> tiles;
+    std::vector<uint64_t> walls;
+} MapSnapshot;
 
 class Map {
     public:
         static const int OUT_OF_BOUNDS = -1;
+        static constexpr int CHUNK_SIZE = 16;
+        static constexpr int MAX_CACHED_CHUNKS = 64;
+        static const uint32_t FILE_VERSION = 3;
+        static const uint32_t SINGLE_LAYER_FILE_VERSION = 2;
+        static const uint32_t BYTE_WALLS_FILE_VERSION = 1;
+        static constexpr int WALL_WORD_BITS = 64;
 
         int width;
         int height;
         vec2 camera_position;
+        bool layer_visible[MAP_LAYER_COUNT];
+
+        // Incremented on every change to the walls, so anything derived from them knows when to rebuild
+        int wall_revision;
+
+        // Advanced every update, and shared by every animated tile
+        uint32_t animation_tick;
 
         Map();
         ~Map();
 
+        void update();
         void render(Engine* engine);
         void render_with_walls(Engine* engine, bool with_walls);
+        // Renders the visible layers from first_layer to last_layer, bottom to top
+        void render_layers(Engine* engine, MapLayer first_layer, MapLayer last_layer);
+
+        bool load_tile_animations(const char* path);
+        uint32_t visible_animation_steps() const;
 
         bool in_bounds(vec2 pos) const;
-        int get_tile(vec2 pos) const;
+        bool is_paged() const {
+            return pager != NULL;
+        }
+        int get_tile(MapLayer layer, vec2 pos) const;
         bool get_wall(vec2 pos) const;
 
-        void set_tile(vec2 pos, int value);
+        void set_tile(MapLayer layer, vec2 pos, int value);
         void set_wall(vec2 pos, bool value);
+        // Set length cells starting at index, continuing onto the following rows
+        void set_tile_run(MapLayer layer, int index, int length, int value);
+        void set_wall_run(int index, int length, bool value);
+        // Clears the tiles of every layer and the walls of a rectangle, which must lie within the map
+        void clear_region(vec2 from, vec2 size);
+        bool row_has_wall(int y, int first_x, int last_x) const;
+        // The walls of count cells of a row starting at first_x, one bit per cell. Counts may be up to WALL_WORD_BITS.
+        uint64_t wall_bits(int y, int first_x, int count) const;
 
         void resize(int new_width, int new_height);
 
         void save_to_file(const char* path);
         void load_from_file(const char* path);
+        void save_to_binary_file(const char* path);
+        bool load_from_binary_file(const char* path);
+        bool open_paged(const char* path, size_t memory_budget);
+
+        void snapshot_write(SnapshotWriter& writer) const;
+        void snapshot_read(SnapshotReader& reader, MapSnapshot& snapshot) const;
+        void snapshot_restore(const MapSnapshot& snapshot);
     private:
-        int* tiles;
-        bool* walls;
+        // Tiles are stored a whole layer after another. Walls are one bit per cell, each row starting on a
+        // new word so rows can be worked on a word at a time.
+        MapTile* tiles;
+        uint64_t* walls;
+        int wall_row_words;
+        MapPager* pager;
+
+        // Pre-rendered CHUNK_SIZE x CHUNK_SIZE blocks of each layer's tiles, re-rendered only when marked dirty.
+        // Only chunks seen recently keep their textures, so large maps don't exhaust video memory
+        std::unordered_map<int, MapChunk> chunks[MAP_LAYER_COUNT];
+        int chunk_columns;
+        int chunk_rows;
+        int render_frame;
+
+        TileAnimationTable tile_animations;
+        std::vector<const MapChunk*> animated_chunks;
+        std::vector<int> visible_animations;
+        std::vector<int> animation_drawn_frame;
+
+        void allocate(int new_width, int new_height);
+        void wall_fill_row(int y, int first_x, int last_x, bool value);
+
+        void chunks_init();
+        void chunks_free();
+        void chunk_mark_dirty(MapLayer layer, vec2 pos);
+        void chunks_mark_run_dirty(MapLayer layer, int index, int length);
+        void chunk_render(Engine* engine, MapLayer layer, int chunk_x, int chunk_y);
 
         inline int to_index(vec2 pos) const {
             return (pos.y * width) + pos.x;
         }
+
+        inline MapTile* layer_tiles(int layer) const {
+            return tiles + ((size_t)layer * width * height);
+        }
+
+        // Positions past either end of a row carry on into the neighbouring row, as they do for tiles
+        inline uint64_t* wall_word(vec2 pos, uint64_t& mask) const {
+            if(pos.x < 0 || pos.x >= width) {
+                int index = to_index(pos);
+                pos = vec2(index % width, index / width);
+            }
+            mask = (uint64_t)1 << (pos.x % WALL_WORD_BITS);
+            return walls + (pos.y * wall_row_words) + (pos.x / WALL_WORD_BITS);
+        }
 };
 
+inline int wall_words_for(int width) {
+    return (width + Map::WALL_WORD_BITS - 1) / Map::WALL_WORD_BITS;
+}
+
 inline vec2 tile_at(vec2 point) {
     return vec2((int)(point.x / Engine::TILE_SIZE), (int)(point.y / Engine::TILE_SIZE));
 }
@@ -0,0 +1,345 @@
+#include "pager.hpp"
+
+#include "map.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+MapPager::MapPager() {
+    width = 0;
+    height = 0;
+    fd = -1;
+    last_page_index = -1;
+    last_page = NULL;
+    stopping = false;
+}
+
+MapPager::~MapPager() {
+    close();
+}
+
+bool MapPager::open(const char* path, size_t memory_budget) {
+    close();
+
+    fd = ::open(path, O_RDWR);
+    if(fd == -1) {
+        std::cout << "Unable to open file!" << std::endl;
+        return false;
+    }
+
+    MapFileHeader header;
+    if(pread(fd, &header, sizeof(MapFileHeader), 0) != sizeof(MapFileHeader) ||
+       memcmp(header.magic, MAP_FILE_MAGIC, 4) != 0 ||
+       (header.version != Map::FILE_VERSION && header.version != Map::SINGLE_LAYER_FILE_VERSION && header.version != Map::BYTE_WALLS_FILE_VERSION) ||
+       header.width <= 0 || header.height <= 0) {
+        std::cout << "Invalid map file!" << std::endl;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    static_assert(PAGE_SIZE == Map::WALL_WORD_BITS, "Each page row's walls are kept in a single word");
+
+    width = header.width;
+    height = header.height;
+    file_version = header.version;
+    file_layers = file_version == Map::FILE_VERSION ? MAP_LAYER_COUNT : 1;
+    wall_row_words = wall_words_for(width);
+    tiles_offset = sizeof(MapFileHeader);
+    walls_offset = tiles_offset + ((size_t)width * (size_t)height * file_layers * (file_version == Map::BYTE_WALLS_FILE_VERSION ? sizeof(int32_t) : sizeof(uint16_t)));
+    page_columns = (width + PAGE_SIZE - 1) / PAGE_SIZE;
+    page_rows = (height + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    // Always keep room for the prefetch window around the camera, whatever the budget
+    const size_t page_bytes = (PAGE_SIZE * PAGE_SIZE * MAP_LAYER_COUNT * sizeof(MapTile)) + (PAGE_SIZE * sizeof(uint64_t));
+    const size_t window_pages = ((PREFETCH_RADIUS * 2) + 1) * ((PREFETCH_RADIUS * 2) + 1);
+    max_resident_pages = std::max(memory_budget / page_bytes, window_pages + 1);
+
+    stopping = false;
+    worker = std::thread(&MapPager::worker_run, this);
+
+    return true;
+}
+
+void MapPager::close() {
+    if(fd == -1) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+        requests.clear();
+    }
+    queue_condition.notify_all();
+    worker.join();
+
+    flush();
+    for(auto& entry : resident) {
+        delete [] entry.second.tiles;
+        delete [] entry.second.walls;
+    }
+    for(MapPageLoad& load : loads) {
+        delete [] load.tiles;
+        delete [] load.walls;
+    }
+    resident.clear();
+    lru.clear();
+    loads.clear();
+    page_versions.clear();
+    page_requested.clear();
+    last_page_index = -1;
+    last_page = NULL;
+
+    ::close(fd);
+    fd = -1;
+}
+
+void MapPager::flush() {
+    for(auto& entry : resident) {
+        if(entry.second.modified) {
+            page_write(entry.first, entry.second);
+            entry.second.modified = false;
+        }
+    }
+}
+
+// Adopts pages the worker has finished reading, then queues reads for the pages around the camera
+void MapPager::update(vec2 center_tile) {
+    std::vector<MapPageLoad> finished_loads;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        finished_loads.swap(loads);
+    }
+
+    for(MapPageLoad& load : finished_loads) {
+        page_requested.erase(load.request.page);
+
+        // A page that became resident after the read was queued may have changed since, so its read is stale
+        if(resident.find(load.request.page) != resident.end() || page_versions[load.request.page] != load.request.version) {
+            delete [] load.tiles;
+            delete [] load.walls;
+            continue;
+        }
+        page_insert(load.request.page, load.tiles, load.walls);
+    }
+
+    vec2 center_page = vec2(center_tile.x / PAGE_SIZE, center_tile.y / PAGE_SIZE);
+    bool requested = false;
+    for(int page_y = std::max(center_page.y - PREFETCH_RADIUS, 0); page_y <= std::min(center_page.y + PREFETCH_RADIUS, page_rows - 1); page_y++) {
+        for(int page_x = std::max(center_page.x - PREFETCH_RADIUS, 0); page_x <= std::min(center_page.x + PREFETCH_RADIUS, page_columns - 1); page_x++) {
+            int page = (page_y * page_columns) + page_x;
+
+            auto resident_page = resident.find(page);
+            if(resident_page != resident.end()) {
+                lru.splice(lru.begin(), lru, resident_page->second.lru_position);
+                continue;
+            }
+            if(page_requested.find(page) != page_requested.end()) {
+                continue;
+            }
+
+            page_requested[page] = true;
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            requests.push_back((MapPageRequest) {
+                .page = page,
+                .version = page_versions[page]
+            });
+            requested = true;
+        }
+    }
+
+    if(requested) {
+        queue_condition.notify_one();
+    }
+}
+
+int MapPager::get_tile(MapLayer layer, int index) {
+    int offset;
+    MapPage& page = page_for(index, offset);
+    return page.tiles[(layer * PAGE_SIZE * PAGE_SIZE) + offset];
+}
+
+bool MapPager::get_wall(int index) {
+    int offset;
+    MapPage& page = page_for(index, offset);
+    return ((page.walls[offset / PAGE_SIZE] >> (offset % PAGE_SIZE)) & 1) != 0;
+}
+
+void MapPager::set_tile(MapLayer layer, int index, int value) {
+    int offset;
+    MapPage& page = page_for(index, offset);
+    page.tiles[(layer * PAGE_SIZE * PAGE_SIZE) + offset] = (MapTile)value;
+    page.modified = true;
+}
+
+void MapPager::set_wall(int index, bool value) {
+    int offset;
+    MapPage& page = page_for(index, offset);
+    uint64_t mask = (uint64_t)1 << (offset % PAGE_SIZE);
+    uint64_t& word = page.walls[offset / PAGE_SIZE];
+    word = value ? (word | mask) : (word & ~mask);
+    page.modified = true;
+}
+
+// Finds the resident page holding a map index, reading it in on the spot if the prefetch didn't get to it
+MapPage& MapPager::page_for(int index, int& offset) {
+    int x = index % width;
+    int y = index / width;
+    int page = ((y / PAGE_SIZE) * page_columns) + (x / PAGE_SIZE);
+    offset = ((y % PAGE_SIZE) * PAGE_SIZE) + (x % PAGE_SIZE);
+
+    if(page == last_page_index) {
+        return *last_page;
+    }
+
+    auto resident_page = resident.find(page);
+    if(resident_page != resident.end()) {
+        lru.splice(lru.begin(), lru, resident_page->second.lru_position);
+        last_page_index = page;
+        last_page = &resident_page->second;
+        return *last_page;
+    }
+
+    MapTile* tiles = new MapTile[PAGE_SIZE * PAGE_SIZE * MAP_LAYER_COUNT];
+    uint64_t* walls = new uint64_t[PAGE_SIZE];
+    page_read(page, tiles, walls);
+    return page_insert(page, tiles, walls);
+}
+
+MapPage& MapPager::page_insert(int page, MapTile* tiles, uint64_t* walls) {
+    // Bumping the version invalidates any read of this page that is still in flight
+    page_versions[page]++;
+
+    lru.push_front(page);
+    MapPage& inserted = resident[page];
+    inserted = (MapPage) {
+        .tiles = tiles,
+        .walls = walls,
+        .modified = false,
+        .lru_position = lru.begin()
+    };
+
+    while(resident.size() > max_resident_pages) {
+        page_evict(lru.back());
+    }
+
+    last_page_index = page;
+    last_page = &inserted;
+
+    return inserted;
+}
+
+void MapPager::page_evict(int page) {
+    auto resident_page = resident.find(page);
+    if(resident_page->second.modified) {
+        page_write(page, resident_page->second);
+    }
+
+    delete [] resident_page->second.tiles;
+    delete [] resident_page->second.walls;
+    lru.erase(resident_page->second.lru_position);
+    resident.erase(resident_page);
+
+    if(last_page_index == page) {
+        last_page_index = -1;
+        last_page = NULL;
+    }
+}
+
+// Version 1 files are converted a row at a time as pages are read and written. The layers a file
+// doesn't have are read as empty, and never written.
+void MapPager::page_read(int page, MapTile* tiles, uint64_t* walls) const {
+    vec2 base = vec2((page % page_columns) * PAGE_SIZE, (page / page_columns) * PAGE_SIZE);
+    int row_length = std::min(PAGE_SIZE, width - base.x);
+    size_t layer_cells = (size_t)width * (size_t)height;
+    int32_t old_tiles[PAGE_SIZE];
+    uint8_t old_walls[PAGE_SIZE];
+
+    memset(tiles, 0, sizeof(MapTile) * PAGE_SIZE * PAGE_SIZE);
+    std::fill(tiles + (PAGE_SIZE * PAGE_SIZE), tiles + (PAGE_SIZE * PAGE_SIZE * MAP_LAYER_COUNT), MAP_TILE_EMPTY);
+    memset(walls, 0, sizeof(uint64_t) * PAGE_SIZE);
+    for(int row = 0; row < PAGE_SIZE && base.y + row < height; row++) {
+        size_t cell = ((size_t)(base.y + row) * (size_t)width) + base.x;
+        bool read = true;
+        if(file_version != Map::BYTE_WALLS_FILE_VERSION) {
+            size_t wall_word = ((size_t)(base.y + row) * wall_row_words) + (base.x / PAGE_SIZE);
+            for(int layer = 0; read && layer < file_layers; layer++) {
+                read = pread(fd, tiles + (layer * PAGE_SIZE * PAGE_SIZE) + (row * PAGE_SIZE), row_length * sizeof(uint16_t),
+                             tiles_offset + (((layer * layer_cells) + cell) * sizeof(uint16_t))) != -1;
+            }
+            read = read && pread(fd, walls + row, sizeof(uint64_t), walls_offset + (wall_word * sizeof(uint64_t))) != -1;
+        } else {
+            read = pread(fd, old_tiles, row_length * sizeof(int32_t), tiles_offset + (cell * sizeof(int32_t))) != -1 &&
+                   pread(fd, old_walls, row_length * sizeof(uint8_t), walls_offset + (cell * sizeof(uint8_t))) != -1;
+            for(int x = 0; read && x < row_length; x++) {
+                tiles[(row * PAGE_SIZE) + x] = (MapTile)old_tiles[x];
+                walls[row] |= (uint64_t)(old_walls[x] != 0) << x;
+            }
+        }
+        if(!read) {
+            std::cout << "Unable to read map page!" << std::endl;
+            return;
+        }
+    }
+}
+
+void MapPager::page_write(int page, const MapPage& data) const {
+    vec2 base = vec2((page % page_columns) * PAGE_SIZE, (page / page_columns) * PAGE_SIZE);
+    int row_length = std::min(PAGE_SIZE, width - base.x);
+    size_t layer_cells = (size_t)width * (size_t)height;
+    int32_t old_tiles[PAGE_SIZE];
+    uint8_t old_walls[PAGE_SIZE];
+
+    for(int row = 0; row < PAGE_SIZE && base.y + row < height; row++) {
+        size_t cell = ((size_t)(base.y + row) * (size_t)width) + base.x;
+        bool written = true;
+        if(file_version != Map::BYTE_WALLS_FILE_VERSION) {
+            size_t wall_word = ((size_t)(base.y + row) * wall_row_words) + (base.x / PAGE_SIZE);
+            for(int layer = 0; written && layer < file_layers; layer++) {
+                written = pwrite(fd, data.tiles + (layer * PAGE_SIZE * PAGE_SIZE) + (row * PAGE_SIZE), row_length * sizeof(uint16_t),
+                                 tiles_offset + (((layer * layer_cells) + cell) * sizeof(uint16_t))) != -1;
+            }
+            written = written && pwrite(fd, data.walls + row, sizeof(uint64_t), walls_offset + (wall_word * sizeof(uint64_t))) != -1;
+        } else {
+            for(int x = 0; x < row_length; x++) {
+                old_tiles[x] = data.tiles[(row * PAGE_SIZE) + x];
+                old_walls[x] = (data.walls[row] >> x) & 1;
+            }
+            written = pwrite(fd, old_tiles, row_length * sizeof(int32_t), tiles_offset + (cell * sizeof(int32_t))) != -1 &&
+                      pwrite(fd, old_walls, row_length * sizeof(uint8_t), walls_offset + (cell * sizeof(uint8_t))) != -1;
+        }
+        if(!written) {
+            std::cout << "Unable to write map page!" << std::endl;
+            return;
+        }
+    }
+}
+
+void MapPager::worker_run() {
+    while(true) {
+        MapPageRequest request;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_condition.wait(lock, [this] { return stopping || !requests.empty(); });
+            if(stopping) {
+                return;
+            }
+            request = requests.front();
+            requests.pop_front();
+        }
+
+        MapTile* tiles = new MapTile[PAGE_SIZE * PAGE_SIZE * MAP_LAYER_COUNT];
+        uint64_t* walls = new uint64_t[PAGE_SIZE];
+        page_read(request.page, tiles, walls);
+
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        loads.push_back((MapPageLoad) {
+            .request = request,
+            .tiles = tiles,
+            .walls = walls
+        });
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "vector.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Tile ids are stored this narrow wherever a map is held in memory
+typedef uint16_t MapTile;
+
+// Cells of a layer with nothing drawn on them hold this id
+const MapTile MAP_TILE_EMPTY = 0xFFFF;
+
+// Maps are drawn as a stack of tile layers. Actors are drawn after the layers below MAP_LAYER_OVERLAY.
+typedef enum MapLayer {
+    MAP_LAYER_GROUND,
+    MAP_LAYER_DETAIL,
+    MAP_LAYER_OVERLAY,
+    MAP_LAYER_COUNT
+} MapLayer;
+
+// A page holds PAGE_SIZE x PAGE_SIZE tiles of every layer, one layer after another. Each page row's walls
+// fit in one word, since PAGE_SIZE matches the map's wall word size.
+typedef struct MapPage {
+    MapTile* tiles;
+    uint64_t* walls;
+    bool modified;
+    std::list<int>::iterator lru_position;
+} MapPage;
+
+typedef struct MapPageRequest {
+    int page;
+    int version;
+} MapPageRequest;
+
+typedef struct MapPageLoad {
+    MapPageRequest request;
+    MapTile* tiles;
+    uint64_t* walls;
+} MapPageLoad;
+
+// Streams PAGE_SIZE x PAGE_SIZE blocks of a binary map file in and out of memory. Pages near the camera
+// are read on a background thread, and the least recently used pages are written back and evicted
+// whenever the resident set grows past the memory budget. Everything but the file reads happens on
+// the thread that owns the map.
+class MapPager {
+    public:
+        static constexpr int PAGE_SIZE = 64;
+        static constexpr int PREFETCH_RADIUS = 1;
+
+        int width;
+        int height;
+
+        MapPager();
+        ~MapPager();
+
+        bool open(const char* path, size_t memory_budget);
+        void close();
+        void flush();
+
+        void update(vec2 center_tile);
+
+        // Files from before maps had layers only hold the ground layer
+        bool has_layer(MapLayer layer) const {
+            return layer < file_layers;
+        }
+
+        int get_tile(MapLayer layer, int index);
+        bool get_wall(int index);
+        void set_tile(MapLayer layer, int index, int value);
+        void set_wall(int index, bool value);
+    private:
+        int fd;
+        uint32_t file_version;
+        int file_layers;
+        int wall_row_words;
+        size_t tiles_offset;
+        size_t walls_offset;
+        size_t max_resident_pages;
+        int page_columns;
+        int page_rows;
+
+        std::unordered_map<int, MapPage> resident;
+        std::list<int> lru;
+        std::unordered_map<int, int> page_versions;
+        std::unordered_map<int, bool> page_requested;
+        int last_page_index;
+        MapPage* last_page;
+
+        std::thread worker;
+        std::mutex queue_mutex;
+        std::condition_variable queue_condition;
+        std::deque<MapPageRequest> requests;
+        std::vector<MapPageLoad> loads;
+        bool stopping;
+
+        MapPage& page_for(int index, int& offset);
+        MapPage& page_insert(int page, MapTile* tiles, uint64_t* walls);
+        void page_evict(int page);
+        void page_read(int page, MapTile* tiles, uint64_t* walls) const;
+        void page_write(int page, const MapPage& data) const;
+        void worker_run();
+};
@@ -0,0 +1,383 @@
+#include "path.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <iterator>
+
+const vec2 STEPS[4] = {
+    vec2(0, -1),
+    vec2(1, 0),
+    vec2(0, 1),
+    vec2(-1, 0),
+};
+
+static bool search_node_compare(const PathSearchNode& a, const PathSearchNode& b) {
+    // Orders the open list as a min-heap on estimated total cost, preferring nodes further along on ties
+    if(a.estimate != b.estimate) {
+        return a.estimate > b.estimate;
+    }
+    return a.cost < b.cost;
+}
+
+void Pathfinder::init(const Map* map) {
+    this->map = map;
+    wall_revision = map->wall_revision;
+    requests_since_aging = 0;
+}
+
+// Returns the direction of the first step from one tile towards another, or -1 if there is no route.
+// Destinations that keep getting asked for get a cached flow field, everything else is searched with A*.
+int Pathfinder::next_direction(vec2 from, vec2 to) {
+    if(from.equals(to) || !is_passable(to)) {
+        return -1;
+    }
+
+    note_request(to, 1);
+    int direction = peek_direction(from, to);
+    if(direction == SEARCH_REQUIRED) {
+        direction = search_route(from, to, search_scratch, route_scratch) ? route_scratch.back() : -1;
+    }
+
+    return direction;
+}
+
+// Answers from a cached flow field, or returns SEARCH_REQUIRED if none covers the start tile
+int Pathfinder::peek_direction(vec2 from, vec2 to) const {
+    if(from.equals(to)) {
+        return -1;
+    }
+    if(wall_revision != map->wall_revision) {
+        return SEARCH_REQUIRED;
+    }
+
+    auto cached_field = flow_fields.find((to.y * map->width) + to.x);
+    if(cached_field == flow_fields.end()) {
+        return SEARCH_REQUIRED;
+    }
+
+    const FlowField& field = cached_field->second;
+    vec2 local = from - field.origin;
+    const int size = (FLOW_FIELD_RADIUS * 2) + 1;
+    if(local.x < 0 || local.x >= size || local.y < 0 || local.y >= size) {
+        return SEARCH_REQUIRED;
+    }
+
+    uint8_t step = field.directions[(local.y * size) + local.x];
+    return step < STEP_ARRIVED ? step : -1;
+}
+
+// Finds a route with A* and stores its steps as directions, last step first, so that following the route
+// only ever pops from the back. Returns false if there is no route.
+bool Pathfinder::search_route(vec2 from, vec2 to, PathSearch& search, std::vector<uint8_t>& steps) const {
+    steps.clear();
+    if(from.equals(to) || !is_passable(to)) {
+        return false;
+    }
+
+    int index = this->search(from, to, search);
+    if(index == -1) {
+        return false;
+    }
+
+    int from_index = search.parent[index];
+    while(from_index != -1) {
+        steps.push_back((uint8_t)search_tile(search, from_index).direction_to(search_tile(search, index)));
+        index = from_index;
+        from_index = search.parent[index];
+    }
+    return true;
+}
+
+// Counts queries towards a destination, building a flow field for it once it has been asked for often enough.
+// When the cache is full a new field is only built if its destination is in more demand than the least
+// recently used field, so that many destinations of similar popularity don't keep evicting each other.
+void Pathfinder::note_request(vec2 to, int count) {
+    cache_validate();
+
+    requests_since_aging += count;
+    if(requests_since_aging >= REQUEST_AGING_PERIOD) {
+        requests_age();
+    }
+
+    int destination = (to.y * map->width) + to.x;
+    auto cached_field = flow_fields.find(destination);
+    if(cached_field != flow_fields.end()) {
+        cached_field->second.requests += count;
+        flow_field_lru.splice(flow_field_lru.begin(), flow_field_lru, cached_field->second.lru_position);
+        return;
+    }
+
+    int requests = destination_requests[destination] += count;
+    if(requests >= FLOW_FIELD_REQUESTS && is_passable(to)) {
+        if((int)flow_fields.size() < MAX_FLOW_FIELDS || requests > flow_fields.at(flow_field_lru.back()).requests) {
+            flow_field_build(to, requests);
+        }
+    } else if((int)destination_requests.size() > MAX_TRACKED_DESTINATIONS) {
+        destination_requests.clear();
+    }
+}
+
+// Halves every request count, so that demand from long ago slowly stops counting
+void Pathfinder::requests_age() {
+    requests_since_aging = 0;
+
+    for(auto it = destination_requests.begin(); it != destination_requests.end();) {
+        it->second /= 2;
+        if(it->second == 0) {
+            it = destination_requests.erase(it);
+        } else {
+            it++;
+        }
+    }
+    for(auto& entry : flow_fields) {
+        entry.second.requests /= 2;
+    }
+}
+
+bool Pathfinder::find_path(vec2 from, vec2 to, std::vector<vec2>& path) {
+    path.clear();
+    if(!is_passable(from) || !is_passable(to)) {
+        return false;
+    }
+    if(from.equals(to)) {
+        path.push_back(to);
+        return true;
+    }
+
+    int index = search(from, to, search_scratch);
+    if(index == -1) {
+        return false;
+    }
+
+    for(; index != -1; index = search_scratch.parent[index]) {
+        path.push_back(search_tile(search_scratch, index));
+    }
+    std::reverse(path.begin(), path.end());
+
+    return true;
+}
+
+void Pathfinder::snapshot_write(SnapshotWriter& writer) const {
+    writer.write_value(requests_since_aging);
+
+    std::vector<int> destinations;
+    std::vector<int> destination_counts;
+    for(const auto& entry : destination_requests) {
+        destinations.push_back(entry.first);
+        destination_counts.push_back(entry.second);
+    }
+    writer.write_column(destinations);
+    writer.write_column(destination_counts);
+
+    // Fields are saved most recently used first, with their directions back to back
+    std::vector<vec2> field_destinations;
+    std::vector<int> field_requests;
+    std::vector<uint8_t> field_directions;
+    for(int key : flow_field_lru) {
+        const FlowField& field = flow_fields.at(key);
+        field_destinations.push_back(field.destination);
+        field_requests.push_back(field.requests);
+        field_directions.insert(field_directions.end(), field.directions.begin(), field.directions.end());
+    }
+    writer.write_column(field_destinations);
+    writer.write_column(field_requests);
+    writer.write_column(field_directions);
+}
+
+void Pathfinder::snapshot_read(SnapshotReader& reader, PathfinderSnapshot& snapshot) const {
+    const size_t field_size = ((FLOW_FIELD_RADIUS * 2) + 1) * ((FLOW_FIELD_RADIUS * 2) + 1);
+
+    snapshot.requests_since_aging = 0;
+    reader.read_value(snapshot.requests_since_aging);
+    reader.read_column(snapshot.destinations);
+    reader.read_column(snapshot.destination_counts);
+    reader.read_column(snapshot.field_destinations);
+    reader.read_column(snapshot.field_requests);
+    reader.read_column(snapshot.field_directions);
+    if(snapshot.destinations.size() != snapshot.destination_counts.size() ||
+       snapshot.field_destinations.size() != snapshot.field_requests.size() ||
+       snapshot.field_destinations.size() > MAX_FLOW_FIELDS ||
+       snapshot.field_directions.size() != snapshot.field_destinations.size() * field_size) {
+        reader.fail();
+        return;
+    }
+
+    // Each destination has one field, so a repeated one would leave the LRU list pointing at a field twice
+    std::vector<uint64_t> field_keys;
+    for(vec2 destination : snapshot.field_destinations) {
+        field_keys.push_back(((uint64_t)(uint32_t)destination.y << 32) | (uint32_t)destination.x);
+    }
+    std::sort(field_keys.begin(), field_keys.end());
+    if(std::adjacent_find(field_keys.begin(), field_keys.end()) != field_keys.end()) {
+        reader.fail();
+    }
+}
+
+// The map must be restored first, since the cache is only valid for the walls it was built against
+void Pathfinder::snapshot_restore(const PathfinderSnapshot& snapshot) {
+    const size_t field_size = ((FLOW_FIELD_RADIUS * 2) + 1) * ((FLOW_FIELD_RADIUS * 2) + 1);
+
+    flow_fields.clear();
+    flow_field_lru.clear();
+    destination_requests.clear();
+    wall_revision = map->wall_revision;
+    requests_since_aging = snapshot.requests_since_aging;
+
+    for(size_t i = 0; i < snapshot.destinations.size(); i++) {
+        destination_requests[snapshot.destinations[i]] = snapshot.destination_counts[i];
+    }
+    for(size_t i = 0; i < snapshot.field_destinations.size(); i++) {
+        vec2 destination = snapshot.field_destinations[i];
+        int key = (destination.y * map->width) + destination.x;
+        flow_field_lru.push_back(key);
+
+        FlowField& field = flow_fields[key];
+        field.destination = destination;
+        field.origin = destination - vec2(FLOW_FIELD_RADIUS, FLOW_FIELD_RADIUS);
+        field.directions.assign(snapshot.field_directions.begin() + (i * field_size), snapshot.field_directions.begin() + ((i + 1) * field_size));
+        field.requests = snapshot.field_requests[i];
+        field.lru_position = std::prev(flow_field_lru.end());
+    }
+}
+
+bool Pathfinder::is_passable(vec2 tile) const {
+    return tile.x >= 0 && tile.x < map->width && tile.y >= 0 && tile.y < map->height && !map->get_wall(tile);
+}
+
+void Pathfinder::cache_validate() {
+    if(wall_revision == map->wall_revision) {
+        return;
+    }
+
+    flow_fields.clear();
+    flow_field_lru.clear();
+    destination_requests.clear();
+    wall_revision = map->wall_revision;
+}
+
+// Breadth first search outwards from the destination, recording in each tile the step back towards the tile it was reached from
+const FlowField& Pathfinder::flow_field_build(vec2 destination, int requests) {
+    const int size = (FLOW_FIELD_RADIUS * 2) + 1;
+    int key = (destination.y * map->width) + destination.x;
+
+    if((int)flow_fields.size() == MAX_FLOW_FIELDS) {
+        flow_fields.erase(flow_field_lru.back());
+        flow_field_lru.pop_back();
+    }
+    flow_field_lru.push_front(key);
+    destination_requests.erase(key);
+
+    FlowField& field = flow_fields[key];
+    field.destination = destination;
+    field.origin = destination - vec2(FLOW_FIELD_RADIUS, FLOW_FIELD_RADIUS);
+    field.directions.assign(size * size, STEP_NONE);
+    field.requests = requests;
+    field.lru_position = flow_field_lru.begin();
+
+    std::deque<vec2> frontier;
+    field.directions[(FLOW_FIELD_RADIUS * size) + FLOW_FIELD_RADIUS] = STEP_ARRIVED;
+    frontier.push_back(destination);
+    while(!frontier.empty()) {
+        vec2 current = frontier.front();
+        frontier.pop_front();
+
+        for(int direction = 0; direction < 4; direction++) {
+            vec2 neighbour = current + STEPS[direction];
+            vec2 local = neighbour - field.origin;
+            if(local.x < 0 || local.x >= size || local.y < 0 || local.y >= size) {
+                continue;
+            }
+            uint8_t& step = field.directions[(local.y * size) + local.x];
+            if(step != STEP_NONE || !is_passable(neighbour)) {
+                continue;
+            }
+
+            step = (uint8_t)((direction + 2) % 4);
+            frontier.push_back(neighbour);
+        }
+    }
+
+    return field;
+}
+
+// A* over the walls with a Manhattan heuristic. Returns the destination's index in the search box, with the
+// search's parent table holding the route back to the start, whose parent is -1, or -1 if no route was found
+// within MAX_SEARCH_NODES expansions. Routes may only detour SEARCH_MARGIN tiles outside the box spanned by the
+// two ends, which keeps searches towards unreachable tiles from flooding the whole map.
+int Pathfinder::search(vec2 from, vec2 to, PathSearch& search) const {
+    vec2 bounds_min = vec2(std::max(std::min(from.x, to.x) - SEARCH_MARGIN, 0), std::max(std::min(from.y, to.y) - SEARCH_MARGIN, 0));
+    vec2 bounds_max = vec2(std::min(std::max(from.x, to.x) + SEARCH_MARGIN, map->width - 1), std::min(std::max(from.y, to.y) + SEARCH_MARGIN, map->height - 1));
+    vec2 size = bounds_max - bounds_min + vec2(1, 1);
+
+    search.origin = bounds_min;
+    search.width = size.x;
+    if((size_t)(size.x * size.y) > search.stamp.size()) {
+        search.stamp.resize(size.x * size.y, 0);
+        search.cost.resize(size.x * size.y);
+        search.parent.resize(size.x * size.y);
+    }
+    if(++search.epoch == 0) {
+        std::fill(search.stamp.begin(), search.stamp.end(), 0);
+        search.epoch = 1;
+    }
+
+    vec2 local_from = from - bounds_min;
+    vec2 local_to = to - bounds_min;
+    int from_index = (local_from.y * size.x) + local_from.x;
+    int to_index = (local_to.y * size.x) + local_to.x;
+
+    search.open.clear();
+    search.stamp[from_index] = search.epoch;
+    search.cost[from_index] = 0;
+    search.parent[from_index] = -1;
+    search.open.push_back((PathSearchNode) {
+        .cost = 0,
+        .estimate = from.manhatten_distance_to(to),
+        .index = from_index
+    });
+
+    int expanded = 0;
+    while(!search.open.empty() && expanded < MAX_SEARCH_NODES) {
+        std::pop_heap(search.open.begin(), search.open.end(), search_node_compare);
+        PathSearchNode current = search.open.back();
+        search.open.pop_back();
+
+        if(current.index == to_index) {
+            return to_index;
+        }
+        if(current.cost > search.cost[current.index]) {
+            continue;
+        }
+        expanded++;
+
+        vec2 current_local = vec2(current.index % size.x, current.index / size.x);
+        for(int direction = 0; direction < 4; direction++) {
+            vec2 neighbour_local = current_local + STEPS[direction];
+            if(neighbour_local.x < 0 || neighbour_local.x >= size.x || neighbour_local.y < 0 || neighbour_local.y >= size.y) {
+                continue;
+            }
+            vec2 neighbour = bounds_min + neighbour_local;
+            if(map->get_wall(neighbour)) {
+                continue;
+            }
+
+            int neighbour_index = (neighbour_local.y * size.x) + neighbour_local.x;
+            int cost = current.cost + 1;
+            if(search.stamp[neighbour_index] == search.epoch && search.cost[neighbour_index] <= cost) {
+                continue;
+            }
+
+            search.stamp[neighbour_index] = search.epoch;
+            search.cost[neighbour_index] = cost;
+            search.parent[neighbour_index] = current.index;
+            search.open.push_back((PathSearchNode) {
+                .cost = cost,
+                .estimate = cost + neighbour.manhatten_distance_to(to),
+                .index = neighbour_index
+            });
+            std::push_heap(search.open.begin(), search.open.end(), search_node_compare);
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "map.hpp"
+#include "vector.hpp"
+#include "snapshot.hpp"
+#include <cstdint>
+#include <list>
+#include <vector>
+#include <unordered_map>
+
+// A flow field stores, for every tile in a window around a destination, the direction of the
+// first step of a shortest path from that tile to the destination
+typedef struct FlowField {
+    vec2 destination;
+    vec2 origin;
+    std::vector<uint8_t> directions;
+    int requests;
+    std::list<int>::iterator lru_position;
+} FlowField;
+
+typedef struct PathSearchNode {
+    int cost;
+    int estimate;
+    int index;
+} PathSearchNode;
+
+// Scratch space for one A* search at a time. Concurrent searches each need their own. Costs and parents are
+// dense over the search's box, indexed by the tile's offset in it, and only hold this search's values where
+// the stamp matches the epoch, so starting a search never has to clear them.
+typedef struct PathSearch {
+    std::vector<PathSearchNode> open;
+    std::vector<int> cost;
+    std::vector<int> parent;
+    std::vector<uint32_t> stamp;
+    uint32_t epoch = 0;
+    vec2 origin;
+    int width;
+} PathSearch;
+
+// A pathfinder's cache read from a snapshot, kept apart from the pathfinder until the rest of the snapshot has been checked
+typedef struct PathfinderSnapshot {
+    int requests_since_aging;
+    std::vector<int> destinations;
+    std::vector<int> destination_counts;
+    std::vector<vec2> field_destinations;
+    std::vector<int> field_requests;
+    std::vector<uint8_t> field_directions;
+} PathfinderSnapshot;
+
+class Pathfinder {
+    public:
+        static constexpr int FLOW_FIELD_RADIUS = 64;
+        static constexpr int FLOW_FIELD_REQUESTS = 32;
+        static constexpr int MAX_FLOW_FIELDS = 32;
+        static constexpr int MAX_TRACKED_DESTINATIONS = 4096;
+        static constexpr int REQUEST_AGING_PERIOD = 4096;
+        static constexpr int MAX_SEARCH_NODES = 1 << 16;
+        static constexpr int SEARCH_MARGIN = 32;
+        static constexpr uint8_t STEP_NONE = 0xFF;
+        static constexpr uint8_t STEP_ARRIVED = 4;
+        static constexpr int SEARCH_REQUIRED = -2;
+
+        void init(const Map* map);
+
+        int next_direction(vec2 from, vec2 to);
+        bool find_path(vec2 from, vec2 to, std::vector<vec2>& path);
+
+        // Read-only queries that are safe to run from several threads at once, as long as the map isn't paged
+        int peek_direction(vec2 from, vec2 to) const;
+        bool search_route(vec2 from, vec2 to, PathSearch& search, std::vector<uint8_t>& steps) const;
+        void note_request(vec2 to, int count);
+
+        int flow_field_count() const {
+            return (int)flow_fields.size();
+        }
+
+        // Which destinations have flow fields decides how NPCs break ties between equally short routes, so snapshots keep the cache
+        void snapshot_write(SnapshotWriter& writer) const;
+        void snapshot_read(SnapshotReader& reader, PathfinderSnapshot& snapshot) const;
+        void snapshot_restore(const PathfinderSnapshot& snapshot);
+    private:
+        const Map* map;
+        int wall_revision;
+
+        std::unordered_map<int, FlowField> flow_fields;
+        std::list<int> flow_field_lru;
+        std::unordered_map<int, int> destination_requests;
+        int requests_since_aging;
+
+        PathSearch search_scratch;
+        std::vector<uint8_t> route_scratch;
+
+        bool is_passable(vec2 tile) const;
+        void cache_validate();
+        const FlowField& flow_field_build(vec2 destination, int requests);
+        void requests_age();
+        int search(vec2 from, vec2 to, PathSearch& search) const;
+        vec2 search_tile(const PathSearch& search, int index) const {
+            return search.origin + vec2(index % search.width, index / search.width);
+        }
+};
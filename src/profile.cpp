@@ -0,0 +1,182 @@
+#include "profile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+const char* profile_phase_names[PROFILE_PHASE_COUNT] = {
+    "EVENTS",
+    "UPDATE",
+    "RENDER",
+    "PRESENT",
+    "SLEEP"
+};
+
+// Profiler init functions
+
+bool Profiler::init(const char* csv_path) {
+    clock_frequency = SDL_GetPerformanceFrequency();
+    last_frame_counter = SDL_GetPerformanceCounter();
+    current = (ProfileFrame) {};
+    history.assign(HISTORY_SIZE, (ProfileFrame) {});
+    percentile_scratch.reserve(HISTORY_SIZE);
+
+    if(csv_path != NULL) {
+        csv_file.open(csv_path);
+        if(!csv_file.is_open()) {
+            std::cout << "Unable to open profile output file " << csv_path << "!" << std::endl;
+            return false;
+        }
+
+        csv_file << "frame";
+        for(int phase = 0; phase < PROFILE_PHASE_COUNT; phase++) {
+            csv_file << "," << profile_phase_names[phase] << "_ms";
+        }
+        csv_file << ",frame_ms,updates" << std::endl;
+    }
+
+    return true;
+}
+
+void Profiler::quit() {
+    if(csv_file.is_open()) {
+        csv_write_pending();
+        csv_file.close();
+    }
+}
+
+// Profiler recording functions
+
+void Profiler::phase_begin(ProfilePhase phase) {
+    phase_start[phase] = SDL_GetPerformanceCounter();
+}
+
+void Profiler::phase_end(ProfilePhase phase) {
+    current.phase_time[phase] += SDL_GetPerformanceCounter() - phase_start[phase];
+}
+
+void Profiler::frame_end(int updates) {
+    Uint64 current_counter = SDL_GetPerformanceCounter();
+    current.frame_time = current_counter - last_frame_counter;
+    current.updates = updates;
+    last_frame_counter = current_counter;
+
+    history[history_next] = current;
+    history_next = (history_next + 1) % HISTORY_SIZE;
+    history_count = std::min(history_count + 1, HISTORY_SIZE);
+    frame_number++;
+    current = (ProfileFrame) {};
+
+    if(csv_file.is_open() && frame_number - csv_written == HISTORY_SIZE) {
+        csv_write_pending();
+    }
+}
+
+void Profiler::csv_write_pending() {
+    char line[256];
+    for(int frame = csv_written; frame < frame_number; frame++) {
+        const ProfileFrame& recorded = history[frame % HISTORY_SIZE];
+        int length = snprintf(line, sizeof(line), "%d", frame);
+        for(int phase = 0; phase < PROFILE_PHASE_COUNT; phase++) {
+            length += snprintf(line + length, sizeof(line) - length, ",%.3f", to_ms(recorded.phase_time[phase]));
+        }
+        snprintf(line + length, sizeof(line) - length, ",%.3f,%d\n", to_ms(recorded.frame_time), recorded.updates);
+        csv_file << line;
+    }
+    csv_file.flush();
+    csv_written = frame_number;
+}
+
+// Profiler query functions
+
+float Profiler::to_ms(Uint64 counter) const {
+    return (float)((double)counter * 1000.0 / (double)clock_frequency);
+}
+
+// Returns the given percentile of one phase over the recorded frames, or of the whole frame if phase is PROFILE_PHASE_COUNT
+float Profiler::percentile_ms(int phase, float percentile) {
+    if(history_count == 0) {
+        return 0.0f;
+    }
+
+    percentile_scratch.clear();
+    for(int i = 0; i < history_count; i++) {
+        const ProfileFrame& recorded = history[i];
+        percentile_scratch.push_back(phase == PROFILE_PHASE_COUNT ? recorded.frame_time : recorded.phase_time[phase]);
+    }
+
+    int rank = std::min((int)(percentile * history_count), history_count - 1);
+    std::nth_element(percentile_scratch.begin(), percentile_scratch.begin() + rank, percentile_scratch.end());
+    return to_ms(percentile_scratch[rank]);
+}
+
+// Profiler render functions
+
+void Profiler::overlay_refresh() {
+    overlay_refreshed_frame = frame_number;
+
+    for(int phase = 0; phase <= PROFILE_PHASE_COUNT; phase++) {
+        const char* name = phase == PROFILE_PHASE_COUNT ? "FRAME" : profile_phase_names[phase];
+        snprintf(overlay_lines[phase], sizeof(overlay_lines[phase]), "%-7s%5.1f%5.1f", name, percentile_ms(phase, 0.5f), percentile_ms(phase, 0.99f));
+    }
+
+    const int bucket_width = Engine::SCREEN_WIDTH / HISTOGRAM_BUCKETS;
+    overlay_p50_x = std::min((int)(percentile_ms(PROFILE_PHASE_COUNT, 0.5f) * bucket_width), Engine::SCREEN_WIDTH - 1);
+    overlay_p99_x = std::min((int)(percentile_ms(PROFILE_PHASE_COUNT, 0.99f) * bucket_width), Engine::SCREEN_WIDTH - 1);
+}
+
+void Profiler::render_overlay(Engine* engine) {
+    if(frame_number - overlay_refreshed_frame >= OVERLAY_REFRESH_FRAMES) {
+        overlay_refresh();
+    }
+
+    int y = 16;
+    engine->render_text("        P50  P99", 0, y);
+    y += 8;
+    for(int phase = 0; phase <= PROFILE_PHASE_COUNT; phase++) {
+        engine->render_text(overlay_lines[phase], 0, y);
+        y += 8;
+    }
+
+    // Histogram of frame times in one millisecond buckets, the last bucket holding everything slower
+    int bucket_counts[HISTOGRAM_BUCKETS] = {};
+    int highest_count = 1;
+    for(int i = 0; i < history_count; i++) {
+        int bucket = std::min((int)to_ms(history[i].frame_time), HISTOGRAM_BUCKETS - 1);
+        bucket_counts[bucket]++;
+        highest_count = std::max(highest_count, bucket_counts[bucket]);
+    }
+
+    const int bucket_width = Engine::SCREEN_WIDTH / HISTOGRAM_BUCKETS;
+    const int base_y = Engine::SCREEN_HEIGHT;
+    engine->render_flush();
+
+    SDL_Rect background = (SDL_Rect) {
+        .x = 0,
+        .y = base_y - HISTOGRAM_HEIGHT,
+        .w = Engine::SCREEN_WIDTH,
+        .h = HISTOGRAM_HEIGHT
+    };
+    SDL_SetRenderDrawColor(engine->renderer, 0, 0, 0, 255);
+    SDL_RenderFillRect(engine->renderer, &background);
+
+    SDL_SetRenderDrawColor(engine->renderer, 255, 255, 255, 255);
+    for(int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        if(bucket_counts[bucket] == 0) {
+            continue;
+        }
+        int bar_height = std::max(1, (bucket_counts[bucket] * HISTOGRAM_HEIGHT) / highest_count);
+        SDL_Rect bar = (SDL_Rect) {
+            .x = bucket * bucket_width,
+            .y = base_y - bar_height,
+            .w = bucket_width - 1,
+            .h = bar_height
+        };
+        SDL_RenderFillRect(engine->renderer, &bar);
+    }
+
+    SDL_SetRenderDrawColor(engine->renderer, 0, 255, 0, 255);
+    SDL_RenderDrawLine(engine->renderer, overlay_p50_x, base_y - HISTOGRAM_HEIGHT, overlay_p50_x, base_y - 1);
+    SDL_SetRenderDrawColor(engine->renderer, 255, 0, 0, 255);
+    SDL_RenderDrawLine(engine->renderer, overlay_p99_x, base_y - HISTOGRAM_HEIGHT, overlay_p99_x, base_y - 1);
+}
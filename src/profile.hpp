@@ -0,0 +1,85 @@
+#pragma once
+
+#include "engine.hpp"
+#include <SDL2/SDL.h>
+#include <fstream>
+#include <vector>
+
+typedef enum ProfilePhase {
+    PROFILE_EVENTS,
+    PROFILE_UPDATE,
+    PROFILE_RENDER,
+    PROFILE_PRESENT,
+    PROFILE_SLEEP,
+    PROFILE_PHASE_COUNT
+} ProfilePhase;
+
+extern const char* profile_phase_names[PROFILE_PHASE_COUNT];
+
+typedef struct ProfileFrame {
+    Uint64 phase_time[PROFILE_PHASE_COUNT];
+    Uint64 frame_time;
+    int updates;
+} ProfileFrame;
+
+// Records how long each phase of the last HISTORY_SIZE frames took in a ring buffer. When writing to a
+// CSV file, the ring is appended to the file every time it fills up, so memory use stays fixed.
+class Profiler {
+    public:
+        static constexpr int HISTORY_SIZE = 1024;
+        static constexpr int HISTOGRAM_BUCKETS = 40;
+        static constexpr int HISTOGRAM_HEIGHT = 32;
+        static constexpr int OVERLAY_REFRESH_FRAMES = 30;
+
+        bool overlay_visible = false;
+
+        bool init(const char* csv_path);
+        void quit();
+
+        void phase_begin(ProfilePhase phase);
+        void phase_end(ProfilePhase phase);
+        void frame_end(int updates);
+
+        float percentile_ms(int phase, float percentile);
+        void render_overlay(Engine* engine);
+    private:
+        Uint64 clock_frequency;
+        Uint64 last_frame_counter;
+        Uint64 phase_start[PROFILE_PHASE_COUNT];
+
+        ProfileFrame current;
+        std::vector<ProfileFrame> history;
+        int history_next = 0;
+        int history_count = 0;
+        int frame_number = 0;
+
+        std::ofstream csv_file;
+        int csv_written = 0;
+
+        std::vector<Uint64> percentile_scratch;
+
+        // The overlay is only recomputed every OVERLAY_REFRESH_FRAMES frames, so it stays readable and its text stays cached
+        char overlay_lines[PROFILE_PHASE_COUNT + 1][32];
+        int overlay_p50_x;
+        int overlay_p99_x;
+        int overlay_refreshed_frame = -OVERLAY_REFRESH_FRAMES;
+
+        void overlay_refresh();
+
+        float to_ms(Uint64 counter) const;
+        void csv_write_pending();
+};
+
+// Times the enclosing block as one phase of the current frame
+class ProfileScope {
+    public:
+        ProfileScope(Profiler& profiler, ProfilePhase phase) : profiler(profiler), phase(phase) {
+            profiler.phase_begin(phase);
+        }
+        ~ProfileScope() {
+            profiler.phase_end(phase);
+        }
+    private:
+        Profiler& profiler;
+        ProfilePhase phase;
+};
@@ -0,0 +1,97 @@
+#include "replay.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+const char REPLAY_FILE_MAGIC[4] = { 'F', 'F', 'R', 'P' };
+
+void InputRecording::clear() {
+    npcs = 0;
+    seed = 0;
+    events.clear();
+    tick_hashes.clear();
+}
+
+// Only key events are kept, since they are all the world reacts to
+void InputRecording::record_event(const SDL_Event& e) {
+    if(e.type != SDL_KEYDOWN && e.type != SDL_KEYUP) {
+        return;
+    }
+
+    events.push_back((ReplayEvent) {
+        .tick = (uint32_t)tick_hashes.size(),
+        .type = e.type,
+        .key = e.key.keysym.sym
+    });
+}
+
+void InputRecording::record_tick(uint64_t state_hash) {
+    tick_hashes.push_back(state_hash);
+}
+
+SDL_Event InputRecording::event_at(int index) const {
+    SDL_Event e;
+    SDL_zero(e);
+    e.type = events[index].type;
+    e.key.keysym.sym = events[index].key;
+    return e;
+}
+
+bool InputRecording::save(const char* path) const {
+    std::ofstream outfile(path, std::ios::out | std::ios::binary);
+    if(!outfile.is_open()) {
+        std::cout << "Unable to open file!" << std::endl;
+        return false;
+    }
+
+    ReplayFileHeader header;
+    memcpy(header.magic, REPLAY_FILE_MAGIC, 4);
+    header.version = REPLAY_FILE_VERSION;
+    header.npcs = npcs;
+    header.seed = seed;
+    header.event_count = events.size();
+    header.tick_count = tick_hashes.size();
+
+    outfile.write((const char*)&header, sizeof(ReplayFileHeader));
+    outfile.write((const char*)events.data(), sizeof(ReplayEvent) * events.size());
+    outfile.write((const char*)tick_hashes.data(), sizeof(uint64_t) * tick_hashes.size());
+
+    if(!outfile.good()) {
+        std::cout << "Unable to write replay!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool InputRecording::load(const char* path) {
+    clear();
+
+    std::ifstream infile(path, std::ios::in | std::ios::binary);
+    if(!infile.is_open()) {
+        std::cout << "Unable to open file!" << std::endl;
+        return false;
+    }
+
+    ReplayFileHeader header;
+    infile.read((char*)&header, sizeof(ReplayFileHeader));
+    if(!infile.good() || memcmp(header.magic, REPLAY_FILE_MAGIC, 4) != 0 || header.version != REPLAY_FILE_VERSION) {
+        std::cout << "Invalid replay file!" << std::endl;
+        return false;
+    }
+
+    npcs = header.npcs;
+    seed = header.seed;
+    events.resize(header.event_count);
+    tick_hashes.resize(header.tick_count);
+    infile.read((char*)events.data(), sizeof(ReplayEvent) * events.size());
+    infile.read((char*)tick_hashes.data(), sizeof(uint64_t) * tick_hashes.size());
+    if(!infile.good()) {
+        std::cout << "Invalid replay file!" << std::endl;
+        clear();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <cstdint>
+#include <vector>
+
+// Replay files are this header, then event_count ReplayEvents in tick order, then the world's state hash
+// after each of the tick_count recorded ticks. Worlds populated with extra NPCs record how they were populated.
+extern const char REPLAY_FILE_MAGIC[4];
+static const uint32_t REPLAY_FILE_VERSION = 1;
+
+typedef struct ReplayFileHeader {
+    char magic[4];
+    uint32_t version;
+    int32_t npcs;
+    uint32_t seed;
+    uint32_t event_count;
+    uint32_t tick_count;
+} ReplayFileHeader;
+
+// A key event and the tick it arrived before, which is the number of ticks simulated so far
+typedef struct ReplayEvent {
+    uint32_t tick;
+    uint32_t type;
+    int32_t key;
+} ReplayEvent;
+
+// The input a world received and the state it ended up in after every tick, so a replay can feed it
+// the same input at the same ticks and tell exactly where it stops matching
+class InputRecording {
+    public:
+        int npcs = 0;
+        unsigned int seed = 0;
+        std::vector<ReplayEvent> events;
+        std::vector<uint64_t> tick_hashes;
+
+        void clear();
+        void record_event(const SDL_Event& e);
+        void record_tick(uint64_t state_hash);
+
+        SDL_Event event_at(int index) const;
+
+        bool save(const char* path) const;
+        bool load(const char* path);
+};
@@ -0,0 +1,121 @@
+#include "snapshot.hpp"
+
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char SNAPSHOT_FILE_MAGIC[4] = { 'F', 'F', 'S', 'N' };
+
+// Snapshot writer functions
+
+bool SnapshotWriter::open(const char* path) {
+    file.open(path, std::ios::out | std::ios::binary);
+    if(!file.is_open()) {
+        std::cout << "Unable to open file!" << std::endl;
+        return false;
+    }
+
+    // The header is rewritten with the final data size once everything else is written
+    SnapshotFileHeader header = {};
+    file.write((const char*)&header, sizeof(SnapshotFileHeader));
+    data_size = 0;
+
+    return true;
+}
+
+bool SnapshotWriter::close() {
+    SnapshotFileHeader header;
+    memcpy(header.magic, SNAPSHOT_FILE_MAGIC, 4);
+    header.version = SNAPSHOT_FILE_VERSION;
+    header.data_size = data_size;
+    file.seekp(0);
+    file.write((const char*)&header, sizeof(SnapshotFileHeader));
+
+    bool written = file.good();
+    file.close();
+    if(!written) {
+        std::cout << "Unable to write snapshot!" << std::endl;
+    }
+
+    return written;
+}
+
+void SnapshotWriter::write_bytes(const void* data, size_t length) {
+    file.write((const char*)data, length);
+    data_size += length;
+}
+
+// Snapshot reader functions
+
+SnapshotReader::SnapshotReader() {
+    data = NULL;
+    size = 0;
+    offset = 0;
+    error = false;
+}
+
+SnapshotReader::~SnapshotReader() {
+    close();
+}
+
+// Maps a snapshot into memory, checking its header and that none of it was cut off
+bool SnapshotReader::open(const char* path) {
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if(fd == -1) {
+        std::cout << "Unable to open file!" << std::endl;
+        return false;
+    }
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) == -1 || (size_t)file_stat.st_size < sizeof(SnapshotFileHeader)) {
+        std::cout << "Invalid snapshot file!" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    size = file_stat.st_size;
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED) {
+        std::cout << "Unable to map file!" << std::endl;
+        data = NULL;
+        return false;
+    }
+
+    const SnapshotFileHeader* header = (const SnapshotFileHeader*)data;
+    if(memcmp(header->magic, SNAPSHOT_FILE_MAGIC, 4) != 0 || header->version != SNAPSHOT_FILE_VERSION ||
+       header->data_size != size - sizeof(SnapshotFileHeader)) {
+        std::cout << "Invalid snapshot file!" << std::endl;
+        close();
+        return false;
+    }
+
+    offset = sizeof(SnapshotFileHeader);
+    error = false;
+
+    return true;
+}
+
+void SnapshotReader::close() {
+    if(data != NULL) {
+        munmap(data, size);
+        data = NULL;
+    }
+}
+
+void SnapshotReader::read_bytes(void* destination, size_t length) {
+    if(error || size - offset < length) {
+        error = true;
+        return;
+    }
+    // Empty columns have no storage to copy into
+    if(length == 0) {
+        return;
+    }
+    memcpy(destination, (const char*)data + offset, length);
+    offset += length;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Snapshot files are this header followed by values and columns of plain data. A column is a uint32 element
+// count and then the elements exactly as they are laid out in memory, so each one saves and loads with a
+// single bulk copy. Readers must read everything back in the order it was written.
+extern const char SNAPSHOT_FILE_MAGIC[4];
+static const uint32_t SNAPSHOT_FILE_VERSION = 5;
+
+typedef struct SnapshotFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t data_size;
+} SnapshotFileHeader;
+
+class SnapshotWriter {
+    public:
+        bool open(const char* path);
+        bool close();
+
+        template<typename T>
+        void write_value(const T& value) {
+            static_assert(std::is_trivially_copyable<T>::value, "Snapshots only hold plain data");
+            write_bytes(&value, sizeof(T));
+        }
+
+        template<typename T>
+        void write_array(const T* data, size_t count) {
+            static_assert(std::is_trivially_copyable<T>::value, "Snapshots only hold plain data");
+            write_value((uint32_t)count);
+            write_bytes(data, sizeof(T) * count);
+        }
+
+        template<typename T>
+        void write_column(const std::vector<T>& column) {
+            write_array(column.data(), column.size());
+        }
+
+        void write_string(const std::string& value) {
+            write_array(value.data(), value.length());
+        }
+    private:
+        std::ofstream file;
+        uint64_t data_size;
+
+        void write_bytes(const void* data, size_t length);
+};
+
+// Reads a snapshot mapped into memory. Any read past the end or of an array of the wrong length marks the
+// reader as failed, after which every read does nothing, so callers only need to check once at the end.
+class SnapshotReader {
+    public:
+        SnapshotReader();
+        ~SnapshotReader();
+
+        bool open(const char* path);
+        void close();
+        bool failed() const {
+            return error;
+        }
+        void fail() {
+            error = true;
+        }
+        size_t remaining() const {
+            return size - offset;
+        }
+
+        template<typename T>
+        void read_value(T& value) {
+            static_assert(std::is_trivially_copyable<T>::value, "Snapshots only hold plain data");
+            read_bytes(&value, sizeof(T));
+        }
+
+        // Reads an array whose length the caller already knows, failing if the snapshot's differs
+        template<typename T>
+        void read_array(T* data, size_t count) {
+            static_assert(std::is_trivially_copyable<T>::value, "Snapshots only hold plain data");
+            uint32_t stored_count = 0;
+            read_value(stored_count);
+            if(!error && stored_count != count) {
+                error = true;
+            }
+            read_bytes(data, sizeof(T) * count);
+        }
+
+        template<typename T>
+        void read_column(std::vector<T>& column) {
+            static_assert(std::is_trivially_copyable<T>::value, "Snapshots only hold plain data");
+            uint32_t count = 0;
+            read_value(count);
+            if(error || size - offset < (size_t)count * sizeof(T)) {
+                error = true;
+                return;
+            }
+            column.resize(count);
+            read_bytes(column.data(), sizeof(T) * count);
+        }
+
+        void read_string(std::string& value) {
+            uint32_t length = 0;
+            read_value(length);
+            if(error || size - offset < length) {
+                error = true;
+                return;
+            }
+            value.assign((const char*)data + offset, length);
+            offset += length;
+        }
+    private:
+        void* data;
+        size_t size;
+        size_t offset;
+        bool error;
+
+        void read_bytes(void* destination, size_t length);
+};
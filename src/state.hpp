@@ -9,4 +9,6 @@ class State {
         virtual void handle_input(SDL_Event e) = 0;
         virtual void update() = 0;
         virtual void render(Engine* engine) = 0;
+        // Whether rendering now would draw anything different from the last render, so unchanged frames can be skipped
+        virtual bool has_visible_changes(Engine* engine) = 0;
 };
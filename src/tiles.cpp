@@ -0,0 +1,85 @@
+#include "tiles.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+const char* TILE_ANIMATIONS_PATH = "./res/tiles.txt";
+
+const int MAX_TILE_ANIMATION_FRAMES = 64;
+
+bool TileAnimationTable::load(const char* path) {
+    std::ifstream infile(path, std::ios::in);
+    if(!infile.is_open()) {
+        std::cout << "Unable to open file!" << std::endl;
+        return false;
+    }
+
+    clear();
+    std::string line;
+    int line_frames[MAX_TILE_ANIMATION_FRAMES];
+    while(std::getline(infile, line)) {
+        if(line.empty() || line[0] == '#' || line[0] == '\r') {
+            continue;
+        }
+
+        const char* cursor = line.c_str();
+        char* next;
+        int tile = (int)strtol(cursor, &next, 10);
+        bool valid = next != cursor;
+        cursor = next;
+        int period = (int)strtol(cursor, &next, 10);
+        valid = valid && next != cursor;
+        cursor = next;
+
+        int frame_count = 0;
+        while(valid && frame_count < MAX_TILE_ANIMATION_FRAMES) {
+            int frame = (int)strtol(cursor, &next, 10);
+            if(next == cursor) {
+                break;
+            }
+            line_frames[frame_count++] = frame;
+            cursor = next;
+        }
+
+        if(!valid || add(tile, period, line_frames, frame_count) == TILE_ANIMATION_NONE) {
+            std::cout << "Invalid tile animation line: " << line << "!" << std::endl;
+        }
+    }
+
+    return true;
+}
+
+void TileAnimationTable::clear() {
+    animations.clear();
+    frames.clear();
+    tile_animations.clear();
+}
+
+// Animates a tile id, replacing any animation it had before. Returns the animation's id.
+int TileAnimationTable::add(int tile, int period, const int* tile_frames, int frame_count) {
+    if(tile < 0 || tile >= UINT16_MAX || period <= 0 || frame_count <= 0) {
+        return TILE_ANIMATION_NONE;
+    }
+    for(int i = 0; i < frame_count; i++) {
+        if(tile_frames[i] < 0) {
+            return TILE_ANIMATION_NONE;
+        }
+    }
+
+    int animation = (int)animations.size();
+    animations.push_back((TileAnimation) {
+        .first_frame = (int)frames.size(),
+        .frame_count = frame_count,
+        .period = period
+    });
+    frames.insert(frames.end(), tile_frames, tile_frames + frame_count);
+
+    if(tile >= (int)tile_animations.size()) {
+        tile_animations.resize(tile + 1, TILE_ANIMATION_NONE);
+    }
+    tile_animations[tile] = animation;
+
+    return animation;
+}
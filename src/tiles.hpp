@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+const int TILE_ANIMATION_NONE = -1;
+
+extern const char* TILE_ANIMATIONS_PATH;
+
+typedef struct TileAnimation {
+    int first_frame;
+    int frame_count;
+    // Ticks each frame is shown for
+    int period;
+} TileAnimation;
+
+// Animated tile definitions. A map cell holding an animated tile id shows the animation's frames in turn, picked
+// from a shared tick count whenever it is drawn, so animated cells need no state or updates of their own.
+// Animation files hold one animation per line as the tile id, the period, then the frames of tiles.png to
+// cycle through, separated by spaces. Lines starting with # are ignored.
+class TileAnimationTable {
+    public:
+        bool load(const char* path);
+        void clear();
+        int add(int tile, int period, const int* frames, int frame_count);
+
+        int count() const {
+            return (int)animations.size();
+        }
+        int find(int tile) const {
+            if(tile < 0 || tile >= (int)tile_animations.size()) {
+                return TILE_ANIMATION_NONE;
+            }
+            return tile_animations[tile];
+        }
+        // How many frames the animation has advanced by at a tick, which only changes when the frame shown does
+        uint32_t step_at(int animation, uint32_t tick) const {
+            return tick / animations[animation].period;
+        }
+        int frame_at(int animation, uint32_t tick) const {
+            const TileAnimation& tile_animation = animations[animation];
+            return frames[tile_animation.first_frame + (step_at(animation, tick) % tile_animation.frame_count)];
+        }
+    private:
+        std::vector<TileAnimation> animations;
+        std::vector<int> frames;
+        // The animation of every tile id up to the highest animated one
+        std::vector<int> tile_animations;
+};
@@ -1,14 +1,18 @@
 #include "ui.hpp"
 
-#include <iostream>
+#include <cstring>
 
-const size_t DIALOG_ROW_LENGTH = 18;
 const int DIALOG_TIMER_DURATION = 3;
 
 UI::UI() {
     dialog_rows[0] = new char[DIALOG_ROW_LENGTH];
     dialog_rows[1] = new char[DIALOG_ROW_LENGTH];
     dialog_is_open = false;
+    dialog_display_length = 0;
+    dialog_table = NULL;
+    dialog_page = 0;
+    dialog_page_end = 0;
+    dialog_timer = 0;
 }
 
 UI::~UI() {
@@ -26,8 +30,18 @@ void UI::update() {
     }
 }
 
-void UI::dialog_open(const char* message) {
-    dialog_message = message;
+void UI::set_dialog_table(const DialogTable* table) {
+    dialog_table = table;
+}
+
+void UI::dialog_open(int dialog) {
+    if(dialog == DIALOG_NONE) {
+        dialog_page = 0;
+        dialog_page_end = 0;
+    } else {
+        dialog_page = dialog_table->entry(dialog).first_page;
+        dialog_page_end = dialog_page + dialog_table->entry(dialog).page_count;
+    }
     dialog_progress();
 }
 
@@ -37,12 +51,13 @@ void UI::dialog_progress() {
         return;
     }
 
-    if(dialog_message.length() == 0) {
+    if(dialog_page == dialog_page_end) {
         dialog_is_open = false;
         return;
     }
 
-    dialog_pop_next_lines();
+    dialog_show_page(dialog_page);
+    dialog_page++;
     dialog_display_length = 0;
     dialog_timer = DIALOG_TIMER_DURATION;
     if(!dialog_is_open) {
@@ -50,50 +65,48 @@ void UI::dialog_progress() {
     }
 }
 
-void UI::dialog_pop_next_lines() {
-    // Clean the row buffers
-    for(size_t i = 0; i < DIALOG_ROW_LENGTH; i++) {
-        dialog_rows[0][i] = ' ';
-        dialog_rows[1][i] = ' ';
-    }
-
-    size_t row = 0;
-    size_t col = 0;
-    while(row != 2 && dialog_message.length() != 0) {
-        // Find the next word's size
-        const size_t space_index = dialog_message.find(' ');
-        size_t next_word_size;
-        if(space_index == std::string::npos) {
-            next_word_size = dialog_message.length();
-        } else {
-            next_word_size = space_index;
-        }
-
-        // Check if we have space on this line for that word
-        if(col + next_word_size > DIALOG_ROW_LENGTH) {
-            row++;
-            col = 0;
-            if(row == 2) {
-                break;
-            }
-        }
+void UI::snapshot_write(SnapshotWriter& writer) const {
+    writer.write_value(dialog_page);
+    writer.write_value(dialog_page_end);
+    writer.write_array(dialog_rows[0], DIALOG_ROW_LENGTH);
+    writer.write_array(dialog_rows[1], DIALOG_ROW_LENGTH);
+    writer.write_value(dialog_is_open);
+    writer.write_value(dialog_display_length);
+    writer.write_value(dialog_timer);
+}
 
-        // Pop the next word off the message
-        std::string next_word = dialog_message.substr(0, next_word_size);
-        dialog_message = dialog_message.substr(next_word_size, dialog_message.length() - next_word_size);
+void UI::snapshot_read(SnapshotReader& reader, UISnapshot& snapshot) const {
+    snapshot.dialog_page = 0;
+    snapshot.dialog_page_end = 0;
+    reader.read_value(snapshot.dialog_page);
+    reader.read_value(snapshot.dialog_page_end);
+    reader.read_array(snapshot.dialog_rows[0], DIALOG_ROW_LENGTH);
+    reader.read_array(snapshot.dialog_rows[1], DIALOG_ROW_LENGTH);
+    reader.read_value(snapshot.dialog_is_open);
+    reader.read_value(snapshot.dialog_display_length);
+    reader.read_value(snapshot.dialog_timer);
+    if(snapshot.dialog_page < 0 || snapshot.dialog_page > snapshot.dialog_page_end ||
+       snapshot.dialog_page_end > dialog_table->page_count() || snapshot.dialog_display_length > DIALOG_ROW_LENGTH * 2) {
+        reader.fail();
+    }
+}
 
-        // Fill the row buffer with the word
-        for(char& c : next_word) {
-            dialog_rows[row][col] = c;
-            col++;
-        }
+void UI::snapshot_restore(const UISnapshot& snapshot) {
+    dialog_page = snapshot.dialog_page;
+    dialog_page_end = snapshot.dialog_page_end;
+    memcpy(dialog_rows[0], snapshot.dialog_rows[0], DIALOG_ROW_LENGTH);
+    memcpy(dialog_rows[1], snapshot.dialog_rows[1], DIALOG_ROW_LENGTH);
+    dialog_is_open = snapshot.dialog_is_open;
+    dialog_display_length = snapshot.dialog_display_length;
+    dialog_timer = snapshot.dialog_timer;
+}
 
-        if(space_index != std::string::npos) {
-            dialog_message = dialog_message.substr(1, dialog_message.length() - 1);
-            if(col < DIALOG_ROW_LENGTH) {
-                dialog_rows[row][col] = ' ';
-                col++;
-            }
-        }
+// Copies a page's rows out of the dialog table into the row buffers, padded with spaces
+void UI::dialog_show_page(int page) {
+    const DialogPage& dialog_page = dialog_table->page(page);
+    for(int row = 0; row < 2; row++) {
+        const DialogRow& dialog_row = dialog_page.rows[row];
+        memcpy(dialog_rows[row], dialog_table->row_text(dialog_row), dialog_row.length);
+        memset(dialog_rows[row] + dialog_row.length, ' ', DIALOG_ROW_LENGTH - dialog_row.length);
     }
 }
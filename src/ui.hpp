@@ -1,10 +1,20 @@
 #pragma once
 
-#include <string>
+#include "dialog.hpp"
+#include "snapshot.hpp"
+
+// The dialog state read from a snapshot, kept apart from the UI until the rest of the snapshot has been checked
+typedef struct UISnapshot {
+    int dialog_page;
+    int dialog_page_end;
+    char dialog_rows[2][DIALOG_ROW_LENGTH];
+    bool dialog_is_open;
+    size_t dialog_display_length;
+    int dialog_timer;
+} UISnapshot;
 
 class UI {
     public:
-        std::string dialog_message;
         char* dialog_rows[2];
         bool dialog_is_open;
         size_t dialog_display_length;
@@ -12,10 +22,19 @@ class UI {
         UI();
         ~UI();
         void update();
-        void dialog_open(const char* message);
+        void set_dialog_table(const DialogTable* table);
+        void dialog_open(int dialog);
         void dialog_progress();
+
+        void snapshot_write(SnapshotWriter& writer) const;
+        void snapshot_read(SnapshotReader& reader, UISnapshot& snapshot) const;
+        void snapshot_restore(const UISnapshot& snapshot);
     private:
+        const DialogTable* dialog_table;
+        // The pages of the open dialog still to be shown
+        int dialog_page;
+        int dialog_page_end;
         int dialog_timer;
 
-        void dialog_pop_next_lines();
+        void dialog_show_page(int page);
 };
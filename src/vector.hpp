@@ -39,6 +39,10 @@ typedef struct vec2 {
     int manhatten_length() const {
         return abs(x) + abs(y);
     }
+    // Rounds to the nearest pixel, amount 0 being this and 1 being target
+    vec2 lerp(const vec2& target, float amount) const {
+        return vec2(x + (int)roundf((target.x - x) * amount), y + (int)roundf((target.y - y) * amount));
+    }
     bool equals(const vec2& other) const {
         return x == other.x && y == other.y;
     }
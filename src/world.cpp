@@ -2,10 +2,36 @@
 
 #include <cmath>
 #include <iostream>
+#include <algorithm>
+#include <random>
+#include <unistd.h>
 
 const int INPUT_DIRECTION_KEYMAP[4] = { SDLK_UP, SDLK_RIGHT, SDLK_DOWN, SDLK_LEFT };
 
-const int PLAYER_ACTOR = 0;
+const char* WORLD_MAP_PATH = "./world.map";
+const char* WORLD_STREAMED_MAP_PATH = "./world.bin";
+const size_t WORLD_MAP_MEMORY_BUDGET = 16 * 1024 * 1024;
+
+const int NPC_BATCH_SIZE = 256;
+const int NPC_PROPOSE_UNREACHABLE = -6;
+const int NPC_PROPOSE_HOLD = -5;
+const int NPC_PROPOSE_SKIP = -4;
+const int NPC_PROPOSE_WAIT = -3;
+const int NPC_PROPOSE_MOVE = -2;
+const int NPC_PROPOSE_STAY = -1;
+
+// An NPC blocked this many times in a row holds still for the longest, 1 << NPC_MAX_ROUTE_BACKOFF ticks
+const int NPC_MAX_ROUTE_BACKOFF = 6;
+
+const int ACTOR_BUCKET_TILES = 8;
+
+const int FOG_DIMMED_ALPHA = 160;
+
+const int POPULATE_TILES_PER_NPC = 8;
+const int POPULATE_WALL_PERCENT = 10;
+const int POPULATE_PATH_LENGTH = 3;
+const int POPULATE_PATH_RADIUS = 12;
+
 const vec2 directions[4] = {
     vec2(0, -1),
     vec2(1, 0),
@@ -21,26 +47,33 @@ World::World() {
         input_direction_held[i] = false;
     }
 
+    dialog_table.load(DIALOG_TABLE_PATH);
+    ui.set_dialog_table(&dialog_table);
+
+    map.load_tile_animations(TILE_ANIMATIONS_PATH);
     map.resize(20, 18);
 
     for(int y = 0; y < map.height; y++) {
         for(int x = 0; x < map.width; x++) {
             if(x == 2) {
-                map.set_tile(vec2(x, y), 1);
+                map.set_tile(MAP_LAYER_GROUND, vec2(x, y), 1);
                 map.set_wall(vec2(x, y), true);
             } else {
-                map.set_tile(vec2(x, y), 0);
+                map.set_tile(MAP_LAYER_GROUND, vec2(x, y), 0);
                 map.set_wall(vec2(x, y), false);
             }
         }
     }
 
-    map.load_from_file("./world.map");
+    // Large worlds ship as a binary map that is streamed in around the camera rather than loaded up front
+    if(access(WORLD_STREAMED_MAP_PATH, F_OK) != 0 || !map.open_paged(WORLD_STREAMED_MAP_PATH, WORLD_MAP_MEMORY_BUDGET)) {
+        map.load_from_file(WORLD_MAP_PATH);
+    }
+    pathfinder.init(&map);
+    set_worker_count(1);
 
-    actor_count = 0;
-    actor_init(SPRITE_PLAYER, 5, 2);
+    player = actor_spawn(SPRITE_PLAYER, 5, 2);
 
-    npc_count = 0;
     PathNode path[2] = {
         (PathNode) {
             .position = vec2(3, 6),
@@ -53,9 +86,15 @@ World::World() {
             .wait_direction = 2
         }
     };
-    npc_init(SPRITE_PLAYER, 6, 6, (char*)"I'm looking for wild mushrooms!", path, 2);
+    npc_spawn(SPRITE_PLAYER, 6, 6, dialog_table.find("mushroom_hunter"), path, 2);
 
-    npc_being_talked_to = -1;
+    npc_being_talked_to = entity_handle_null();
+
+    map.camera_position = actors.position[actors.index.index_of(player)] - vec2(Engine::TILE_SIZE * 4, Engine::TILE_SIZE * 4);
+    previous_camera_position = map.camera_position;
+    rendered_hash = 0;
+
+    player_fov_update();
 }
 
 World::~World() {
@@ -73,7 +112,7 @@ void World::handle_input(SDL_Event e) {
                 ui.dialog_progress();
 
                 if(!ui.dialog_is_open) {
-                    npc_being_talked_to = -1;
+                    npc_being_talked_to = entity_handle_null();
                 }
             } else {
                 player_interact();
@@ -115,14 +154,15 @@ void World::handle_input(SDL_Event e) {
 // World update functions
 
 void World::update() {
+    actors.previous_position = actors.position;
+    previous_camera_position = map.camera_position;
+
     player_move();
+    player_fov_update();
+    map.update();
 
-    for(int i = 0; i < npc_count; i++) {
-        if(npc_being_talked_to == i) {
-            continue;
-        }
-        npc_move(npcs[i]);
-    }
+    npcs_update();
+    actor_buckets_update();
 
     ui.update();
 }
@@ -130,18 +170,265 @@ void World::update() {
 // World render functions
 
 void World::render(Engine* engine) {
-    map.render(engine);
-
-    // Render actors
-    for(int i = 0; i < actor_count; i++) {
-        vec2 render_pos = actors[i].position - map.camera_position;
-        engine->render_actor_animation(actors[i].animation, actors[i].facing_direction, render_pos.x, render_pos.y);
+    // Draw everything where it was part way between the last two ticks, so movement stays smooth when frames and ticks don't line up
+    vec2 camera_position = map.camera_position;
+    map.camera_position = previous_camera_position.lerp(camera_position, engine->interpolation);
+
+    map.render_layers(engine, MAP_LAYER_GROUND, MAP_LAYER_DETAIL);
+
+    // Render the actors near the camera, back to front
+    actors_collect_visible(map.camera_position);
+    for(EntityHandle actor : visible_actors) {
+        int i = actors.index.index_of(actor);
+        vec2 render_pos = actors.previous_position[i].lerp(actors.position[i], engine->interpolation) - map.camera_position;
+        if(!actor_is_shown(render_pos, map.camera_position)) {
+            continue;
+        }
+        engine->render_actor_animation(actors.animation[i], actors.facing_direction[i], render_pos.x, render_pos.y);
     }
 
+    map.render_layers(engine, MAP_LAYER_OVERLAY, MAP_LAYER_OVERLAY);
+    fog_render(engine);
+
+    map.camera_position = camera_position;
+
     // Render UI
     if(ui.dialog_is_open) {
         engine->render_dialog(ui.dialog_rows, ui.dialog_display_length);
     }
+
+    rendered_hash = visible_hash(engine->interpolation);
+}
+
+bool World::has_visible_changes(Engine* engine) {
+    return visible_hash(engine->interpolation) != rendered_hash;
+}
+
+// Hashing functions
+
+static inline void hash_int(uint64_t& hash, int value) {
+    // FNV-1a over the four bytes of the value
+    for(int i = 0; i < 4; i++) {
+        hash ^= (uint64_t)((value >> (i * 8)) & 0xFF);
+        hash *= 1099511628211ULL;
+    }
+}
+
+// Hashes everything render would draw at the given interpolation. Actors that would be off screen or out of
+// the player's sight are left out.
+uint64_t World::visible_hash(float interpolation) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    vec2 camera = previous_camera_position.lerp(map.camera_position, interpolation);
+    hash_int(hash, camera.x);
+    hash_int(hash, camera.y);
+    hash_int(hash, map.visible_animation_steps());
+    hash_int(hash, player_fov.revision);
+    actors_collect_visible(camera);
+    for(EntityHandle actor : visible_actors) {
+        int i = actors.index.index_of(actor);
+        vec2 render_pos = actors.previous_position[i].lerp(actors.position[i], interpolation) - camera;
+        if(!actor_is_shown(render_pos, camera)) {
+            continue;
+        }
+        hash_int(hash, i);
+        hash_int(hash, render_pos.x);
+        hash_int(hash, render_pos.y);
+        hash_int(hash, actors.facing_direction[i]);
+        hash_int(hash, actors.animation[i].frame);
+    }
+
+    hash_int(hash, (int)ui.dialog_is_open);
+    if(ui.dialog_is_open) {
+        hash_int(hash, (int)ui.dialog_display_length);
+        for(int row = 0; row < 2; row++) {
+            for(const char* c = ui.dialog_rows[row]; c < ui.dialog_rows[row] + DIALOG_ROW_LENGTH; c++) {
+                hash_int(hash, *c);
+            }
+        }
+    }
+
+    return hash;
+}
+
+uint64_t World::state_hash() const {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for(int i = 0; i < actors.count(); i++) {
+        hash_int(hash, actors.position[i].x);
+        hash_int(hash, actors.position[i].y);
+        hash_int(hash, actors.target[i].x);
+        hash_int(hash, actors.target[i].y);
+        hash_int(hash, actors.facing_direction[i]);
+        hash_int(hash, actors.animation[i].frame);
+        hash_int(hash, actors.animation[i].timer);
+    }
+    for(int i = 0; i < npcs.count(); i++) {
+        hash_int(hash, npcs.path_index[i]);
+        hash_int(hash, npcs.path_timer[i]);
+        hash_int(hash, (int)npcs.route[i].size());
+        hash_int(hash, npcs.route_retry[i]);
+        hash_int(hash, npcs.route_failures[i]);
+    }
+    hash_int(hash, npc_being_talked_to.slot);
+    hash_int(hash, (int)ui.dialog_is_open);
+    hash_int(hash, (int)ui.dialog_display_length);
+    hash_int(hash, map.camera_position.x);
+    hash_int(hash, map.camera_position.y);
+
+    return hash;
+}
+
+// World snapshot functions
+
+// Saves everything the simulation depends on, so that a restored world carries on exactly as this one would
+bool World::save_snapshot(const char* path) const {
+    SnapshotWriter writer;
+    if(!writer.open(path)) {
+        return false;
+    }
+
+    map.snapshot_write(writer);
+    writer.write_value(map.wall_revision);
+    pathfinder.snapshot_write(writer);
+    actors.snapshot_write(writer);
+    npcs.snapshot_write(writer);
+    ui.snapshot_write(writer);
+
+    writer.write_value(player);
+    writer.write_value(npc_being_talked_to);
+    writer.write_value(input_player_direction);
+    writer.write_array(input_direction_held, 4);
+    writer.write_value(previous_camera_position);
+
+    std::vector<int> occupied_tiles;
+    std::vector<EntityHandle> occupants;
+    occupied_tiles.reserve(occupancy.size());
+    occupants.reserve(occupancy.size());
+    for(const auto& entry : occupancy) {
+        occupied_tiles.push_back(entry.first);
+        occupants.push_back(entry.second);
+    }
+    writer.write_column(occupied_tiles);
+    writer.write_column(occupants);
+    explored.snapshot_write(writer);
+
+    return writer.close();
+}
+
+// Checks that every handle in a restored world points at an entity that exists, that NPCs and their actors point
+// at each other, and that every actor and occupied tile lies on the map
+static bool snapshot_entities_valid(const ActorStore& actors, const NPCStore& npcs, int map_width, int map_height,
+                                    const std::vector<int>& occupied_tiles, const std::vector<EntityHandle>& occupants) {
+    auto tile_on_map = [map_width, map_height](vec2 position) {
+        vec2 tile = tile_at(position);
+        return position.x >= 0 && position.y >= 0 && tile.x < map_width && tile.y < map_height;
+    };
+
+    for(int i = 0; i < npcs.count(); i++) {
+        int npc_actor = actors.index.index_of(npcs.actor[i]);
+        if(npc_actor == -1 || !actors.npc[npc_actor].equals(npcs.index.handle_at(i))) {
+            return false;
+        }
+    }
+    for(int i = 0; i < actors.count(); i++) {
+        if(!actors.npc[i].is_null() && npcs.index.index_of(actors.npc[i]) == -1) {
+            return false;
+        }
+        if(!tile_on_map(actors.position[i]) || (!actors.target[i].is_null() && !tile_on_map(actors.target[i]))) {
+            return false;
+        }
+    }
+    for(size_t i = 0; i < occupied_tiles.size(); i++) {
+        if(occupied_tiles[i] < 0 || occupied_tiles[i] >= (int64_t)map_width * map_height || actors.index.index_of(occupants[i]) == -1) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Everything is read and checked before any of it replaces the world's state, so a snapshot that fails to load
+// leaves the world exactly as it was
+bool World::load_snapshot(const char* path) {
+    SnapshotReader reader;
+    if(!reader.open(path)) {
+        return false;
+    }
+
+    MapSnapshot restored_map;
+    int saved_wall_revision = 0;
+    PathfinderSnapshot restored_pathfinder;
+    ActorStore restored_actors;
+    NPCStore restored_npcs;
+    UISnapshot restored_ui;
+    map.snapshot_read(reader, restored_map);
+    reader.read_value(saved_wall_revision);
+    pathfinder.snapshot_read(reader, restored_pathfinder);
+    restored_actors.snapshot_read(reader);
+    restored_npcs.snapshot_read(reader);
+    ui.snapshot_read(reader, restored_ui);
+
+    EntityHandle restored_player = entity_handle_null();
+    EntityHandle restored_npc_being_talked_to = entity_handle_null();
+    int restored_input_player_direction = -1;
+    bool restored_input_direction_held[4];
+    vec2 restored_previous_camera_position;
+    reader.read_value(restored_player);
+    reader.read_value(restored_npc_being_talked_to);
+    reader.read_value(restored_input_player_direction);
+    reader.read_array(restored_input_direction_held, 4);
+    reader.read_value(restored_previous_camera_position);
+
+    std::vector<int> occupied_tiles;
+    std::vector<EntityHandle> occupants;
+    ExploredMap restored_explored;
+    reader.read_column(occupied_tiles);
+    reader.read_column(occupants);
+    restored_explored.snapshot_read(reader);
+    if(reader.failed() || occupied_tiles.size() != occupants.size() || restored_actors.index.index_of(restored_player) == -1 ||
+       (!restored_npc_being_talked_to.is_null() && restored_npcs.index.index_of(restored_npc_being_talked_to) == -1) ||
+       restored_input_player_direction < -1 || restored_input_player_direction > 3 ||
+       !snapshot_entities_valid(restored_actors, restored_npcs, restored_map.width, restored_map.height, occupied_tiles, occupants)) {
+        reader.fail();
+    }
+    for(int dialog : restored_npcs.dialog) {
+        if(dialog < DIALOG_NONE || dialog >= dialog_table.count()) {
+            reader.fail();
+        }
+    }
+    if(reader.failed()) {
+        std::cout << "Invalid snapshot file!" << std::endl;
+        return false;
+    }
+
+    map.snapshot_restore(restored_map);
+    pathfinder.snapshot_restore(restored_pathfinder);
+    actors = std::move(restored_actors);
+    npcs = std::move(restored_npcs);
+    ui.snapshot_restore(restored_ui);
+    explored = std::move(restored_explored);
+
+    player = restored_player;
+    npc_being_talked_to = restored_npc_being_talked_to;
+    input_player_direction = restored_input_player_direction;
+    std::copy(restored_input_direction_held, restored_input_direction_held + 4, input_direction_held);
+    previous_camera_position = restored_previous_camera_position;
+
+    // Wall revisions only count changes within one run, so the NPCs' routes are moved onto the restored map's
+    npcs.wall_revision_rebase(saved_wall_revision, map.wall_revision);
+
+    occupancy.clear();
+    occupancy.reserve(occupied_tiles.size());
+    for(size_t i = 0; i < occupied_tiles.size(); i++) {
+        occupancy[occupied_tiles[i]] = occupants[i];
+    }
+    actor_buckets_rebuild();
+    player_fov.invalidate();
+    player_fov_update();
+    rendered_hash = 0;
+
+    return true;
 }
 
 // Map functions
@@ -151,165 +438,601 @@ bool World::is_tile_free(const vec2& tile) const {
         return false;
     }
 
-    for(int i = 0; i < actor_count; i++) {
-        if(actors[i].target.is_null()) {
-            vec2 position_tile = tile_at(actors[i].position);
-            if(position_tile.equals(tile)) {
-                return false;
-            }
-        } else {
-            int actor_direction = actors[i].position.direction_to(actors[i].target);
-            vec2 target_tile = tile_at(actors[i].target);
-            vec2 last_tile = target_tile - directions[actor_direction];
-            if(target_tile.equals(tile) || last_tile.equals(tile)) {
-                return false;
-            }
-        }
+    if(actor_at(tile) != -1) {
+        return false;
     }
 
     return !map.get_wall(tile);
 }
 
+int World::actor_at(const vec2& tile) const {
+    auto occupant = occupancy.find((tile.y * map.width) + tile.x);
+    if(occupant == occupancy.end()) {
+        return -1;
+    }
+    return actors.index.index_of(occupant->second);
+}
+
+void World::tile_occupy(const vec2& tile, EntityHandle actor) {
+    occupancy[(tile.y * map.width) + tile.x] = actor;
+}
+
+void World::tile_release(const vec2& tile, EntityHandle actor) {
+    auto occupant = occupancy.find((tile.y * map.width) + tile.x);
+    if(occupant != occupancy.end() && occupant->second.equals(actor)) {
+        occupancy.erase(occupant);
+    }
+}
+
 // Player functions
 
 void World::player_move() {
-    Actor& player_actor = actors[PLAYER_ACTOR];
+    int player_actor = actors.index.index_of(player);
     actor_move(player_actor);
-    map.camera_position = player_actor.position - vec2(Engine::TILE_SIZE * 4, Engine::TILE_SIZE * 4);
+    map.camera_position = actors.position[player_actor] - vec2(Engine::TILE_SIZE * 4, Engine::TILE_SIZE * 4);
 
-    if(player_actor.target.is_null() && input_player_direction != -1) {
-        vec2 next_tile = tile_at(player_actor.position) + directions[input_player_direction];
+    if(actors.target[player_actor].is_null() && input_player_direction != -1) {
+        vec2 next_tile = tile_at(actors.position[player_actor]) + directions[input_player_direction];
         if(is_tile_free(next_tile)) {
-            player_actor.target = position_of(next_tile);
+            actor_set_target(player_actor, next_tile);
         } else {
-            player_actor.facing_direction = input_player_direction;
+            actors.facing_direction[player_actor] = input_player_direction;
         }
     }
 }
 
 void World::player_interact() {
-    Actor& player_actor = actors[PLAYER_ACTOR];
-    if(!player_actor.target.is_null()) {
+    int player_actor = actors.index.index_of(player);
+    if(!actors.target[player_actor].is_null()) {
         return;
     }
 
-    vec2 interact_target = position_of(tile_at(player_actor.position) + directions[player_actor.facing_direction]);
+    vec2 interact_tile = tile_at(actors.position[player_actor]) + directions[actors.facing_direction[player_actor]];
 
-    if(!map.in_bounds(tile_at(interact_target))) {
+    if(!map.in_bounds(interact_tile)) {
         return;
     }
 
-    for(int i = 0; i < npc_count; i++) {
-        if(!actors[npcs[i].actor].target.is_null()) {
-            continue;
-        }
-        if(interact_target.equals(actors[npcs[i].actor].position)) {
-            actors[npcs[i].actor].facing_direction = direction_opposite_of(player_actor.facing_direction);
-            npc_being_talked_to = i;
-            ui.dialog_open(npcs[i].dialog);
-            return;
-        }
+    int actor = actor_at(interact_tile);
+    if(actor == -1 || actors.npc[actor].is_null()) {
+        return;
+    }
+    if(!actors.target[actor].is_null() || !actors.position[actor].equals(position_of(interact_tile))) {
+        return;
+    }
+    // NPCs with nothing to say would open no dialog, and nothing would ever end the conversation and let them move on
+    if(npcs.dialog[npcs.index.index_of(actors.npc[actor])] == DIALOG_NONE) {
+        return;
     }
+
+    actors.facing_direction[actor] = direction_opposite_of(actors.facing_direction[player_actor]);
+    npc_being_talked_to = actors.npc[actor];
+    ui.dialog_open(npcs.dialog[npcs.index.index_of(npc_being_talked_to)]);
 }
 
 // Actor functions
 
-int World::actor_init(Sprite sprite, int x, int y) {
-    if(actor_count == MAX_ACTORS) {
-        std::cout << "Cannot create new actor! Max actor count has been reached!" << std::endl;
-        return -1;
+EntityHandle World::actor_spawn(Sprite sprite, int x, int y) {
+    EntityHandle actor = actors.spawn(sprite, position_of(vec2(x, y)));
+    tile_occupy(vec2(x, y), actor);
+    actor_bucket_insert(actors.index.index_of(actor));
+
+    return actor;
+}
+
+void World::actor_despawn(EntityHandle actor) {
+    int actor_index = actors.index.index_of(actor);
+    if(actor_index == -1) {
+        return;
     }
 
-    int actor_index = actor_count;
-    actors[actor_index] = (Actor) {
-        .facing_direction = 2,
-        .position = position_of(vec2(x, y)),
-        .target = vec2_null()
-    };
-    actors[actor_index].animation.init(sprite, 10);
-    actor_count++;
+    // A moving actor holds both the tile it is leaving and the one it is entering
+    vec2 position_tile = tile_at(actors.position[actor_index]);
+    tile_release(position_tile, actor);
+    if(!actors.target[actor_index].is_null()) {
+        vec2 target_tile = tile_at(actors.target[actor_index]);
+        tile_release(target_tile, actor);
+        tile_release(target_tile - directions[actors.position[actor_index].direction_to(actors.target[actor_index])], actor);
+    }
 
-    return actor_index;
+    actor_bucket_remove(actor_index);
+    actors.despawn(actor);
 }
 
-void World::actor_move(Actor& actor) {
-    if(actor.target.is_null()) {
-        actor.animation.reset();
-        return;
+// Starts moving an actor onto a neighbouring tile, reserving it until the actor leaves it again
+void World::actor_set_target(int actor, const vec2& tile) {
+    actors.target[actor] = position_of(tile);
+    tile_occupy(tile, actors.index.handle_at(actor));
+}
+
+void World::actor_move(int actor) {
+    vec2 left_tile;
+    if(actor_step(actor, left_tile)) {
+        tile_release(left_tile, actors.index.handle_at(actor));
+    }
+}
+
+// Moves an actor one pixel towards its target without touching the occupancy table. Returns true
+// when the actor arrives, along with the tile it has now left and whose reservation can be released.
+bool World::actor_step(int actor, vec2& left_tile) {
+    if(actors.target[actor].is_null()) {
+        actors.animation[actor].reset();
+        return false;
     }
 
-    int move_direction = actor.position.direction_to(actor.target);
+    int move_direction = actors.position[actor].direction_to(actors.target[actor]);
     vec2 step = directions[move_direction];
-    actor.position = actor.position + step;
+    actors.position[actor] = actors.position[actor] + step;
 
-    if(actor.position.equals(actor.target)) {
-        actor.target = vec2_null();
+    bool arrived = false;
+    if(actors.position[actor].equals(actors.target[actor])) {
+        left_tile = tile_at(actors.target[actor]) - step;
+        actors.target[actor] = vec2_null();
+        arrived = true;
     }
 
-    actor.facing_direction = move_direction;
-    actor.animation.update();
+    actors.facing_direction[actor] = move_direction;
+    actors.animation[actor].update();
+
+    return arrived;
 }
 
-// NPC functions
+// Field of view functions
 
-int World::npc_init(Sprite sprite, int x, int y, char* dialog, const PathNode* path, int path_length) {
-    if(npc_count == MAX_NPCS) {
-        std::cout << "Cannot create new NPC! Max NPC count has been reached!" << std::endl;
-        return -1;
+// Recomputes what the player can see when they change tile or the walls around them change, marking it all explored
+void World::player_fov_update() {
+    if(player_fov.update(map, tile_at(actors.position[actors.index.index_of(player)]))) {
+        explored.mark_visible(player_fov);
     }
+}
 
-    int npc_index = npc_count;
-    npcs[npc_index].actor = actor_init(sprite, x, y);
-    npcs[npc_index].dialog = dialog;
+// Covers the tiles on screen the player can't see, dimming the ones they've seen before and hiding the rest
+void World::fog_render(Engine* engine) {
+    vec2 start_tile = vec2((int)floor((float)map.camera_position.x / Engine::TILE_SIZE), (int)floor((float)map.camera_position.y / Engine::TILE_SIZE));
+    vec2 base_render_pos = position_of(start_tile) - map.camera_position;
+    fog_hidden_rects.clear();
+    fog_dimmed_rects.clear();
+    for(int y = 0; y <= Engine::SCREEN_HEIGHT / Engine::TILE_SIZE; y++) {
+        for(int x = 0; x <= Engine::SCREEN_WIDTH / Engine::TILE_SIZE; x++) {
+            vec2 tile = start_tile + vec2(x, y);
+            if(player_fov.is_visible(tile)) {
+                continue;
+            }
 
-    npcs[npc_index].path_index = 0;
-    npcs[npc_index].path_length = path_length;
-    npcs[npc_index].path_timer = 0;
+            vec2 render_pos = base_render_pos + position_of(vec2(x, y));
+            SDL_Rect rect = (SDL_Rect) {
+                .x = render_pos.x,
+                .y = render_pos.y,
+                .w = Engine::TILE_SIZE,
+                .h = Engine::TILE_SIZE
+            };
+            if(explored.is_explored(tile)) {
+                fog_dimmed_rects.push_back(rect);
+            } else {
+                fog_hidden_rects.push_back(rect);
+            }
+        }
+    }
+
+    engine->render_flush();
+    SDL_SetRenderDrawBlendMode(engine->renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(engine->renderer, 0, 0, 0, 255);
+    SDL_RenderFillRects(engine->renderer, fog_hidden_rects.data(), (int)fog_hidden_rects.size());
+    SDL_SetRenderDrawColor(engine->renderer, 0, 0, 0, FOG_DIMMED_ALPHA);
+    SDL_RenderFillRects(engine->renderer, fog_dimmed_rects.data(), (int)fog_dimmed_rects.size());
+    SDL_SetRenderDrawBlendMode(engine->renderer, SDL_BLENDMODE_NONE);
+}
 
-    for(int i = 0; i < path_length; i++) {
-        npcs[npc_index].path[i] = path[i];
-        npcs[npc_index].path[i].position = position_of(npcs[npc_index].path[i].position);
+// Actors are drawn when they're on screen and the player can see the tile most of them is on
+bool World::actor_is_shown(vec2 render_pos, vec2 camera) const {
+    if(render_pos.x <= -Engine::TILE_SIZE || render_pos.x >= Engine::SCREEN_WIDTH || render_pos.y <= -Engine::TILE_SIZE || render_pos.y >= Engine::SCREEN_HEIGHT) {
+        return false;
+    }
+    return player_fov.is_visible(tile_at(render_pos + camera + vec2(Engine::TILE_SIZE / 2, Engine::TILE_SIZE / 2)));
+}
+
+// Actor bucket functions
+
+static inline uint64_t actor_bucket_key(vec2 position) {
+    vec2 bucket = tile_at(position);
+    bucket = vec2(bucket.x / ACTOR_BUCKET_TILES, bucket.y / ACTOR_BUCKET_TILES);
+    return ((uint64_t)(uint32_t)bucket.y << 32) | (uint32_t)bucket.x;
+}
+
+// Actors further up the screen are drawn first, so that those in front overlap them
+bool World::actor_draws_before(EntityHandle a, EntityHandle b) const {
+    const vec2& a_position = actors.position[actors.index.index_of(a)];
+    const vec2& b_position = actors.position[actors.index.index_of(b)];
+    if(a_position.y != b_position.y) {
+        return a_position.y < b_position.y;
     }
-    npc_count++;
+    return a_position.x < b_position.x;
+}
 
-    return npc_index;
+void World::actor_bucket_insert(int actor) {
+    actors.bucket[actor] = actor_bucket_key(actors.position[actor]);
+    std::vector<EntityHandle>& bucket = actor_buckets[actors.bucket[actor]];
+    EntityHandle handle = actors.index.handle_at(actor);
+    bucket.insert(std::upper_bound(bucket.begin(), bucket.end(), handle, [this](EntityHandle a, EntityHandle b) {
+        return actor_draws_before(a, b);
+    }), handle);
 }
 
-void World::npc_move(NPC& npc) {
-    // Don't move if this npc never had a path
-    if(npc.path_length == 0) {
+void World::actor_bucket_remove(int actor) {
+    auto bucket = actor_buckets.find(actors.bucket[actor]);
+    if(bucket == actor_buckets.end()) {
         return;
     }
 
-    Actor& npc_actor = actors[npc.actor];
+    EntityHandle handle = actors.index.handle_at(actor);
+    std::vector<EntityHandle>& bucket_actors = bucket->second;
+    for(size_t i = 0; i < bucket_actors.size(); i++) {
+        if(bucket_actors[i].equals(handle)) {
+            bucket_actors.erase(bucket_actors.begin() + i);
+            break;
+        }
+    }
+    if(bucket_actors.empty()) {
+        actor_buckets.erase(bucket);
+    }
+}
+
+// Refiles the actors that moved this tick. Actors only move a pixel per tick, so the buckets they stay in
+// are nearly sorted already and an insertion sort puts them back in order in close to linear time.
+void World::actor_buckets_update() {
+    unsorted_actor_buckets.clear();
+    for(int i = 0; i < actors.count(); i++) {
+        if(actors.position[i].equals(actors.previous_position[i])) {
+            continue;
+        }
+
+        if(actor_bucket_key(actors.position[i]) != actors.bucket[i]) {
+            actor_bucket_remove(i);
+            actor_bucket_insert(i);
+        } else {
+            unsorted_actor_buckets.push_back(actors.bucket[i]);
+        }
+    }
+
+    std::sort(unsorted_actor_buckets.begin(), unsorted_actor_buckets.end());
+    unsorted_actor_buckets.erase(std::unique(unsorted_actor_buckets.begin(), unsorted_actor_buckets.end()), unsorted_actor_buckets.end());
+    for(uint64_t key : unsorted_actor_buckets) {
+        std::vector<EntityHandle>& bucket = actor_buckets.at(key);
+        for(size_t i = 1; i < bucket.size(); i++) {
+            EntityHandle actor = bucket[i];
+            size_t j = i;
+            while(j > 0 && actor_draws_before(actor, bucket[j - 1])) {
+                bucket[j] = bucket[j - 1];
+                j--;
+            }
+            bucket[j] = actor;
+        }
+    }
+}
+
+void World::actor_buckets_rebuild() {
+    actor_buckets.clear();
+    actors.bucket.assign(actors.count(), 0);
+    for(int i = 0; i < actors.count(); i++) {
+        actor_bucket_insert(i);
+    }
+}
+
+// Gathers the actors in the buckets overlapping the screen into visible_actors in draw order. Each row of
+// buckets covers a band of y that the rows below it all come after, so only the buckets within a row need merging.
+void World::actors_collect_visible(vec2 camera) {
+    vec2 first_tile = tile_at(camera - vec2(Engine::TILE_SIZE, Engine::TILE_SIZE));
+    vec2 last_tile = tile_at(camera + vec2(Engine::SCREEN_WIDTH, Engine::SCREEN_HEIGHT));
+    vec2 first_bucket = vec2(std::max(first_tile.x, 0) / ACTOR_BUCKET_TILES, std::max(first_tile.y, 0) / ACTOR_BUCKET_TILES);
+    vec2 last_bucket = vec2(std::max(last_tile.x, 0) / ACTOR_BUCKET_TILES, std::max(last_tile.y, 0) / ACTOR_BUCKET_TILES);
+
+    visible_actors.clear();
+    for(int bucket_y = first_bucket.y; bucket_y <= last_bucket.y; bucket_y++) {
+        size_t row_start = visible_actors.size();
+        for(int bucket_x = first_bucket.x; bucket_x <= last_bucket.x; bucket_x++) {
+            auto bucket = actor_buckets.find(((uint64_t)(uint32_t)bucket_y << 32) | (uint32_t)bucket_x);
+            if(bucket == actor_buckets.end()) {
+                continue;
+            }
+
+            size_t bucket_start = visible_actors.size();
+            visible_actors.insert(visible_actors.end(), bucket->second.begin(), bucket->second.end());
+            std::inplace_merge(visible_actors.begin() + row_start, visible_actors.begin() + bucket_start, visible_actors.end(), [this](EntityHandle a, EntityHandle b) {
+                return actor_draws_before(a, b);
+            });
+        }
+    }
+}
+
+// NPC functions
+
+EntityHandle World::npc_spawn(Sprite sprite, int x, int y, int dialog, const PathNode* path, int path_length) {
+    std::vector<PathNode> pixel_path(path, path + path_length);
+    for(PathNode& node : pixel_path) {
+        node.position = position_of(node.position);
+    }
+
+    EntityHandle actor = actor_spawn(sprite, x, y);
+    EntityHandle npc = npcs.spawn(actor, dialog, pixel_path.data(), path_length);
+    actors.npc[actors.index.index_of(actor)] = npc;
+
+    return npc;
+}
+
+void World::npc_despawn(EntityHandle npc) {
+    int npc_index = npcs.index.index_of(npc);
+    if(npc_index == -1) {
+        return;
+    }
+
+    if(npc.equals(npc_being_talked_to)) {
+        npc_being_talked_to = entity_handle_null();
+        ui.dialog_is_open = false;
+    }
+
+    actor_despawn(npcs.actor[npc_index]);
+    npcs.despawn(npc);
+}
+
+// Checks whether an NPC can see a tile from the tile it is on. Sight is symmetric, so whether it can see the
+// player's tile is already known from the player's field of view.
+bool World::npc_can_see(EntityHandle npc, vec2 tile) const {
+    int npc_index = npcs.index.index_of(npc);
+    if(npc_index == -1) {
+        return false;
+    }
+
+    vec2 npc_tile = tile_at(actors.position[actors.index.index_of(npcs.actor[npc_index])]);
+    if(tile.equals(player_fov.origin) && player_fov.is_visible(npc_tile)) {
+        return true;
+    }
+    return FieldOfView::line_of_sight(map, npc_tile, tile);
+}
+
+void World::set_worker_count(int count) {
+    workers.init(count);
+    worker_path_searches.resize(count);
+    worker_path_requests.resize(count);
+}
+
+// NPCs update in three phases so that they can be spread across threads without the result depending
+// on how many there are. First every NPC proposes a move using only state from the start of the tick,
+// then the proposals are granted tile reservations one NPC at a time in index order, and finally
+// every NPC steps towards its target, with the tiles they leave behind released in index order.
+void World::npcs_update() {
+    const int npc_count = npcs.count();
+    npc_proposals.resize(npc_count);
+    npc_arrived.resize(npc_count);
+    npc_left_tiles.resize(npc_count);
+
+    // Paged maps load pages on access, so their reads can't be shared between threads
+    int batch_size = map.is_paged() ? npc_count : NPC_BATCH_SIZE;
+
+    workers.parallel_for(npc_count, batch_size, [this](int begin, int end, int worker) {
+        for(int i = begin; i < end; i++) {
+            npc_proposals[i] = npc_propose(i, worker);
+        }
+    });
+    npc_requests_note();
+
+    for(int i = 0; i < npc_count; i++) {
+        npc_resolve(i);
+    }
+
+    workers.parallel_for(npc_count, NPC_BATCH_SIZE, [this](int begin, int end, int worker) {
+        (void)worker;
+        for(int i = begin; i < end; i++) {
+            npc_step(i);
+        }
+    });
+
+    for(int i = 0; i < npc_count; i++) {
+        if(npc_arrived[i]) {
+            tile_release(npc_left_tiles[i], npcs.actor[i]);
+        }
+    }
+}
+
+// Only writes to the NPC's own route columns and the worker's scratch, so NPCs can propose from several threads at once
+int World::npc_propose(int npc, int worker) {
+    // Don't move if this npc never had a path or is being talked to
+    if(npcs.path_length[npc] == 0 || npc_being_talked_to.equals(npcs.index.handle_at(npc))) {
+        return NPC_PROPOSE_SKIP;
+    }
 
     // Don't move if this npc is waiting on the current path node
-    if(npc.path_timer > 0) {
-        npc_actor.facing_direction = npc.path[npc.path_index].wait_direction;
-        npc.path_timer--;
+    if(npcs.path_timer[npc] > 0) {
+        return NPC_PROPOSE_WAIT;
+    }
+
+    int npc_actor = actors.index.index_of(npcs.actor[npc]);
+    if(!actors.target[npc_actor].is_null()) {
+        return NPC_PROPOSE_MOVE;
+    }
+
+    // Hold still for a while after being blocked, rather than searching again straight away
+    if(npcs.route_retry[npc] > 0) {
+        npcs.route_retry[npc]--;
+        return NPC_PROPOSE_HOLD;
+    }
+
+    // Nodes that couldn't be reached are skipped until the walls change
+    int node = npcs.path_index[npc];
+    const PathNode& path_node = npcs.path_node(npc, node);
+    if(path_node.unreachable_revision == map.wall_revision) {
+        return NPC_PROPOSE_UNREACHABLE;
+    }
+
+    // Keep following the route to this node for as long as the walls it was found against stay the same
+    std::vector<uint8_t>& route = npcs.route[npc];
+    if(npcs.route_node[npc] == node && npcs.route_revision[npc] == map.wall_revision && !route.empty()) {
+        return route.back();
+    }
+
+    vec2 from = tile_at(actors.position[npc_actor]);
+    vec2 to = tile_at(path_node.position);
+    if(from.equals(to)) {
+        return NPC_PROPOSE_STAY;
+    }
+
+    // Only queries count towards a destination's demand for a flow field, not steps along a cached route
+    worker_path_requests[worker].push_back((to.y * map.width) + to.x);
+    int target_direction = pathfinder.peek_direction(from, to);
+    if(target_direction >= 0) {
+        route.clear();
+        return target_direction;
+    }
+
+    npcs.route_node[npc] = node;
+    npcs.route_revision[npc] = map.wall_revision;
+    if(!pathfinder.search_route(from, to, worker_path_searches[worker], route)) {
+        npcs.path_nodes[npcs.path_start[npc] + node].unreachable_revision = map.wall_revision;
+        return NPC_PROPOSE_UNREACHABLE;
+    }
+
+    return route.back();
+}
+
+// Merges the destinations every worker asked about and counts them in the pathfinder in order of tile index,
+// so the flow fields it builds are the same whichever threads the NPCs ran on
+void World::npc_requests_note() {
+    path_requests.clear();
+    for(std::vector<int>& requests : worker_path_requests) {
+        path_requests.insert(path_requests.end(), requests.begin(), requests.end());
+        requests.clear();
+    }
+    std::sort(path_requests.begin(), path_requests.end());
+
+    for(size_t i = 0; i < path_requests.size();) {
+        size_t run_end = i + 1;
+        while(run_end < path_requests.size() && path_requests[run_end] == path_requests[i]) {
+            run_end++;
+        }
+        pathfinder.note_request(vec2(path_requests[i] % map.width, path_requests[i] / map.width), (int)(run_end - i));
+        i = run_end;
+    }
+}
+
+void World::npc_resolve(int npc) {
+    // Only directions and stays need resolving
+    int proposal = npc_proposals[npc];
+    if(proposal < NPC_PROPOSE_STAY) {
         return;
     }
 
-    // If we've decided to move, check to make sure we have a target to move towards
-    if(npc_actor.target.is_null()) {
-        int target_direction = npc_actor.position.direction_to(npc.path[npc.path_index].position);
-        vec2 next_tile = tile_at(npc_actor.position) + directions[target_direction];
+    int npc_actor = actors.index.index_of(npcs.actor[npc]);
+    if(proposal != NPC_PROPOSE_STAY) {
+        vec2 next_tile = tile_at(actors.position[npc_actor]) + directions[proposal];
         if(is_tile_free(next_tile)) {
-            npc_actor.target = position_of(next_tile);
+            actor_set_target(npc_actor, next_tile);
+            npcs.route_failures[npc] = 0;
+            if(!npcs.route[npc].empty()) {
+                npcs.route[npc].pop_back();
+            }
+        } else {
+            // Blocked, so drop the route and back off for longer each time this keeps happening
+            npcs.route[npc].clear();
+            npcs.route_failures[npc] = std::min(npcs.route_failures[npc] + 1, NPC_MAX_ROUTE_BACKOFF);
+            npcs.route_retry[npc] = 1 << npcs.route_failures[npc];
         }
     }
+    npc_proposals[npc] = NPC_PROPOSE_MOVE;
+}
+
+void World::npc_step(int npc) {
+    npc_arrived[npc] = false;
+
+    int proposal = npc_proposals[npc];
+    if(proposal == NPC_PROPOSE_SKIP || proposal == NPC_PROPOSE_HOLD) {
+        return;
+    }
+    if(proposal == NPC_PROPOSE_UNREACHABLE) {
+        npc_path_advance(npc);
+        return;
+    }
+
+    int npc_actor = actors.index.index_of(npcs.actor[npc]);
+    const PathNode& path_node = npcs.path_node(npc, npcs.path_index[npc]);
 
-    // Now move the actor towards that arget
-    actor_move(npc_actor);
+    if(proposal == NPC_PROPOSE_WAIT) {
+        actors.facing_direction[npc_actor] = path_node.wait_direction;
+        npcs.path_timer[npc]--;
+        return;
+    }
+
+    // Now move the actor towards that target
+    npc_arrived[npc] = actor_step(npc_actor, npc_left_tiles[npc]);
 
     // If after movement we've reached our target path node, increment the path and start the wait timer if there is one
-    if(npc_actor.target.is_null() && npc_actor.position.equals(npc.path[npc.path_index].position)) {
-        npc.path_timer = npc.path[npc.path_index].wait_time;
-        npc_actor.animation.reset();
+    if(actors.target[npc_actor].is_null() && actors.position[npc_actor].equals(path_node.position)) {
+        npcs.path_timer[npc] = path_node.wait_time;
+        actors.animation[npc_actor].reset();
+        npc_path_advance(npc);
+    }
+}
+
+void World::npc_path_advance(int npc) {
+    npcs.path_index[npc]++;
+    if(npcs.path_index[npc] == npcs.path_length[npc]) {
+        npcs.path_index[npc] = std::max(npcs.path_length[npc] - 2, 0);
+    }
+}
 
-        npc.path_index++;
-        if(npc.path_index == npc.path_length) {
-            npc.path_index -= 2;
+// Builds a stress scenario: the map grows to fit npc_count NPCs, gets scattered walls to route
+// around, and each NPC patrols a short random path near where it spawned
+void World::populate(int npc_count, unsigned int seed) {
+    if(map.is_paged()) {
+        std::cout << "Cannot populate a streamed map!" << std::endl;
+        return;
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> percent_distribution(0, 99);
+    std::uniform_int_distribution<int> offset_distribution(-POPULATE_PATH_RADIUS, POPULATE_PATH_RADIUS);
+    std::uniform_int_distribution<int> wait_distribution(0, 60);
+
+    int side = (int)ceil(sqrt((double)(npc_count + actors.count()) * POPULATE_TILES_PER_NPC));
+    map.resize(std::max(side, map.width), std::max(side, map.height));
+
+    // Occupancy is keyed by map index, which the resize just changed
+    occupancy.clear();
+    for(int i = 0; i < actors.count(); i++) {
+        tile_occupy(tile_at(actors.position[i]), actors.index.handle_at(i));
+        if(!actors.target[i].is_null()) {
+            tile_occupy(tile_at(actors.target[i]), actors.index.handle_at(i));
+        }
+    }
+
+    for(int y = 0; y < map.height; y++) {
+        for(int x = 0; x < map.width; x++) {
+            vec2 tile = vec2(x, y);
+            if(actor_at(tile) == -1 && percent_distribution(rng) < POPULATE_WALL_PERCENT) {
+                map.set_wall(tile, true);
+            }
+        }
+    }
+
+    std::uniform_int_distribution<int> x_distribution(0, map.width - 1);
+    std::uniform_int_distribution<int> y_distribution(0, map.height - 1);
+    for(int i = 0; i < npc_count; i++) {
+        vec2 spawn;
+        do {
+            spawn = vec2(x_distribution(rng), y_distribution(rng));
+        } while(!is_tile_free(spawn));
+
+        PathNode path[POPULATE_PATH_LENGTH];
+        for(int node = 0; node < POPULATE_PATH_LENGTH; node++) {
+            vec2 position;
+            do {
+                position = spawn + vec2(offset_distribution(rng), offset_distribution(rng));
+            } while(position.x < 0 || position.x >= map.width || position.y < 0 || position.y >= map.height || map.get_wall(position));
+
+            path[node] = (PathNode) {
+                .position = position,
+                .wait_time = wait_distribution(rng),
+                .wait_direction = 2
+            };
         }
+        npc_spawn(SPRITE_PLAYER, spawn.x, spawn.y, DIALOG_NONE, path, POPULATE_PATH_LENGTH);
     }
 }
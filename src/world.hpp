@@ -4,33 +4,15 @@
 #include "engine.hpp"
 #include "map.hpp"
 #include "ui.hpp"
+#include "dialog.hpp"
 #include "vector.hpp"
+#include "entity.hpp"
+#include "path.hpp"
+#include "jobs.hpp"
+#include "fov.hpp"
 #include <SDL2/SDL.h>
-
-typedef struct Actor {
-    Animation animation;
-    int facing_direction;
-    vec2 position;
-    vec2 target;
-} Actor;
-
-typedef struct PathNode {
-    vec2 position;
-    int wait_time;
-    int wait_direction;
-} PathNode;
-
-typedef struct NPC {
-    int actor;
-    int path_index;
-    int path_length;
-    int path_timer;
-    PathNode path[8];
-    char* dialog;
-} NPC;
-
-static const int MAX_ACTORS = 32;
-static const int MAX_NPCS = 31;
+#include <cstdint>
+#include <unordered_map>
 
 class World : public State {
     public:
@@ -40,27 +22,91 @@ class World : public State {
         void handle_input(SDL_Event e) override;
         void update() override;
         void render(Engine* engine) override;
+        bool has_visible_changes(Engine* engine) override;
+
+        uint64_t state_hash() const;
+        uint64_t visible_hash(float interpolation);
+
+        bool save_snapshot(const char* path) const;
+        bool load_snapshot(const char* path);
+
+        EntityHandle npc_spawn(Sprite sprite, int x, int y, int dialog, const PathNode* path, int path_length);
+        void npc_despawn(EntityHandle npc);
+
+        void set_worker_count(int count);
+        void populate(int npc_count, unsigned int seed);
+
+        bool is_tile_free(const vec2& tile) const;
+        bool npc_can_see(EntityHandle npc, vec2 tile) const;
     private:
         int input_player_direction;
         bool input_direction_held[4];
 
+        DialogTable dialog_table;
         UI ui;
         Map map;
+        Pathfinder pathfinder;
 
-        Actor actors[MAX_ACTORS];
-        int actor_count;
-        NPC npcs[MAX_NPCS];
-        int npc_count;
-        int npc_being_talked_to;
+        ActorStore actors;
+        NPCStore npcs;
+        EntityHandle player;
+        EntityHandle npc_being_talked_to;
+        vec2 previous_camera_position;
+        uint64_t rendered_hash;
 
-        bool is_tile_free(const vec2& tile) const;
+        // What the player can see now, and everything they've seen before, which is drawn dimmed
+        FieldOfView player_fov;
+        ExploredMap explored;
+        std::vector<SDL_Rect> fog_hidden_rects;
+        std::vector<SDL_Rect> fog_dimmed_rects;
+
+        // Maps the index of every tile an actor stands on or is moving between to that actor
+        std::unordered_map<int, EntityHandle> occupancy;
+
+        // Actors filed by the ACTOR_BUCKET_TILES square of tiles they are in, with each bucket kept in draw
+        // order, so rendering only visits actors near the camera and never has to sort the whole population
+        std::unordered_map<uint64_t, std::vector<EntityHandle>> actor_buckets;
+        std::vector<uint64_t> unsorted_actor_buckets;
+        std::vector<EntityHandle> visible_actors;
+
+        // Per-tick NPC scratch, indexed by the NPC's dense index
+        WorkerPool workers;
+        std::vector<PathSearch> worker_path_searches;
+        // Destination tile indices each worker asked the pathfinder about this tick, counted after proposing
+        std::vector<std::vector<int>> worker_path_requests;
+        std::vector<int> path_requests;
+        std::vector<int> npc_proposals;
+        std::vector<char> npc_arrived;
+        std::vector<vec2> npc_left_tiles;
+
+        int actor_at(const vec2& tile) const;
+        void tile_occupy(const vec2& tile, EntityHandle actor);
+        void tile_release(const vec2& tile, EntityHandle actor);
 
         void player_move();
         void player_interact();
 
-        int actor_init(Sprite sprite, int x, int y);
-        void actor_move(Actor& actor);
+        EntityHandle actor_spawn(Sprite sprite, int x, int y);
+        void actor_despawn(EntityHandle actor);
+        void actor_set_target(int actor, const vec2& tile);
+        void player_fov_update();
+        void fog_render(Engine* engine);
+        bool actor_is_shown(vec2 render_pos, vec2 camera) const;
+
+        void actor_move(int actor);
+        bool actor_step(int actor, vec2& left_tile);
+
+        bool actor_draws_before(EntityHandle a, EntityHandle b) const;
+        void actor_bucket_insert(int actor);
+        void actor_bucket_remove(int actor);
+        void actor_buckets_update();
+        void actor_buckets_rebuild();
+        void actors_collect_visible(vec2 camera);
 
-        int npc_init(Sprite sprite, int x, int y, char* dialog, const PathNode* path, int path_length);
-        void npc_move(NPC& npc);
+        void npcs_update();
+        int npc_propose(int npc, int worker);
+        void npc_requests_note();
+        void npc_resolve(int npc);
+        void npc_step(int npc);
+        void npc_path_advance(int npc);
 };
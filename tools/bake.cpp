@@ -0,0 +1,34 @@
+#include "../src/assets.hpp"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <iostream>
+
+// Decodes and packs the sprite sheets once, writing an asset pack the game loads without SDL_image.
+// Run from the repository root so the sprite sheet paths resolve.
+int main(int argc, char** argv) {
+    const char* pack_path = argc > 1 ? argv[1] : ASSET_PACK_PATH;
+
+    int img_flags = IMG_INIT_PNG;
+    if(!(IMG_Init(img_flags) & img_flags)){
+        std::cout << "Unable to initialize SDL_image! SDL Error: " << IMG_GetError() << std::endl;
+        return 1;
+    }
+
+    AssetPackSprite sprites[SPRITE_COUNT];
+    SDL_Surface* atlas = assets_build_atlas(sprites);
+    if(atlas == NULL) {
+        IMG_Quit();
+        return 1;
+    }
+
+    bool written = assets_write_pack(pack_path, sprites, atlas);
+    if(written) {
+        std::cout << "Baked " << SPRITE_COUNT << " sprite sheets into a " << atlas->w << "x" << atlas->h << " atlas at " << pack_path << std::endl;
+    }
+
+    SDL_FreeSurface(atlas);
+    IMG_Quit();
+
+    return written ? 0 : 1;
+}